@@ -0,0 +1,47 @@
+#!/bin/sh
+# Usage: bench/soak.sh [shell] [commands]
+#
+# Feeds COMMANDS lines (default 1000000) through a single non-interactive
+# session: builtins, expansions, redirections, compound commands, syntax
+# errors, and now and then a pipeline or an external command. Every
+# twentieth of the way the session prints its own VmRSS (cat is a builtin,
+# so /proc/self is the shell). Fails if RSS after warm-up grows by more
+# than SOAK_SLACK_KB (default 512).
+SHELL_BIN=${1:-./shell.out}
+COMMANDS=${2:-1000000}
+SLACK_KB=${SOAK_SLACK_KB:-512}
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+mkdir "$WORK/home"
+
+START=$(date +%s)
+awk -v n="$COMMANDS" -v step=$((COMMANDS / 20)) 'BEGIN {
+    for (i = 1; i <= n; i++) {
+        if (i % step == 0) { print "cat /proc/self/status"; continue }
+        if (i % 1000 == 0) { print "/bin/true"; continue }
+        if (i % 100 == 0) { print "echo " i " | cat > /dev/null"; continue }
+        if (i % 100 == 50) { print "echo ;;"; continue }
+        k = i % 8
+        if (k == 0) print "echo soak " i " $HOME ${HOME} $? ~ > /dev/null"
+        else if (k == 1) print "test " i " -gt 0"
+        else if (k == 2) print "[ -n $HOME ]; true; false"
+        else if (k == 3) print "hop /tmp; hop - > /dev/null"
+        else if (k == 4) print "for x in a b c; do echo $x > /dev/null; done"
+        else if (k == 5) print "if test -d /tmp; then true; else false; fi"
+        else if (k == 6) print "cat /etc/hostname > /dev/null"
+        else print "echo -n " i " >> /dev/null"
+    }
+}' | HOME="$WORK/home" "$SHELL_BIN" > "$WORK/out" 2>&1
+END=$(date +%s)
+
+awk -v slack="$SLACK_KB" -v n="$COMMANDS" -v secs=$((END - START)) '
+/^VmRSS:/ { rss[++count] = $2; printf "after %8d commands: %6d kB\n", count * n / 20, $2 }
+END {
+    if (count < 3) { print "soak: too few samples"; exit 1 }
+    # The first samples cover allocator warm-up.
+    base = rss[2]; peak = base
+    for (i = 2; i <= count; i++) if (rss[i] > peak) peak = rss[i]
+    printf "%d commands in %d s; RSS %d kB after warm-up, peak %d kB, final %d kB\n", n, secs, base, peak, rss[count]
+    if (peak - base > slack) { printf "soak: RSS grew by %d kB\n", peak - base; exit 1 }
+}' "$WORK/out"
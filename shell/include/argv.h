@@ -0,0 +1,23 @@
+#ifndef ARGV_H
+#define ARGV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A growable, NULL-terminated word list. Words pushed as owned are freed
+// with the vector; the others are borrowed from elsewhere.
+typedef struct {
+    char** items;
+    bool* owned;
+    int count;
+    int capacity;
+} ArgVector;
+
+#define ARG_VECTOR_INIT { NULL, NULL, 0, 0 }
+
+bool arg_vector_push(ArgVector* vector, char* item, bool owned);
+// Pushes a copy of length bytes of text.
+bool arg_vector_push_copy(ArgVector* vector, const char* text, size_t length);
+void arg_vector_free(ArgVector* vector);
+
+#endif // ARGV_H
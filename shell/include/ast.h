@@ -0,0 +1,50 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stdbool.h>
+
+typedef enum {
+    NODE_COMMAND,   // tokens run through execute(), up to a ';' or '&'
+    NODE_IF,
+    NODE_WHILE,
+    NODE_UNTIL,
+    NODE_FOR,
+    NODE_BREAK,
+    NODE_CONTINUE
+} NodeType;
+
+// One command of a command list. The token strings are borrowed from the
+// token array the tree was parsed from; only the arrays are owned.
+typedef struct Node {
+    NodeType type;
+    char** tokens;            // NODE_COMMAND words, or NODE_FOR's word list
+    int token_count;
+    char* variable;           // NODE_FOR
+    struct Node* condition;   // NODE_IF, NODE_WHILE, NODE_UNTIL
+    struct Node* body;        // then-branch or loop body
+    struct Node* else_branch; // NODE_IF (an elif is a nested NODE_IF)
+    struct Node* next;        // next command in the same list
+} Node;
+
+typedef enum {
+    PARSE_OK,
+    PARSE_INCOMPLETE, // a compound command is still open
+    PARSE_ERROR
+} ParseStatus;
+
+ParseStatus parse_command_list(char** tokens, int token_count, Node** list);
+void free_node_list(Node* list);
+// Runs every command in the list and returns the last exit status.
+int execute_node_list(Node* list, char** prev_dir, char* SHELL_HOME_DIR);
+
+// Parses and runs one line's tokens. While an if/for/while is still open the
+// tokens are kept and joined with the following lines. The caller keeps
+// ownership of tokens.
+void run_tokens(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
+// The same for the last line of non-interactive input: its final command
+// may replace the shell instead of being forked.
+void run_last_tokens(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
+// True while run_tokens() is waiting for the rest of a compound command.
+bool command_pending(void);
+
+#endif // AST_H
@@ -0,0 +1,11 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// batch [-P N] [-n MAX] [-0] command [arg...]
+// Reads items from stdin, one per line (NUL-separated with -0), and runs
+// command with as many of them appended as the kernel's argument limit
+// allows, or at most MAX, keeping up to N runs going at once (-P 0: one per
+// CPU). Returns 0 if every run succeeded and 123 otherwise.
+int batch_command(char** args, int arg_count);
+
+#endif // BATCH_H
@@ -0,0 +1,28 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <stdbool.h>
+
+// At most COMPLETION_LIMIT candidates are collected. total still counts
+// every match and common holds the longest prefix shared by all of them.
+#define COMPLETION_LIMIT 256
+
+typedef struct {
+    char** items;
+    int count;
+    int capacity;
+    int total;
+    char* common;
+} CompletionList;
+
+// Starts a background rescan of the $PATH directories whose mtime changed
+// since the last scan. Cheap to call often; the first call builds the index.
+void path_index_refresh(void);
+
+// Adds every candidate for word to list, sorted. Command words complete
+// against builtins and executables on $PATH, other words against files.
+// Directories are suffixed with '/'.
+void complete_word(const char* word, bool command_position, CompletionList* list);
+void free_completion_list(CompletionList* list);
+
+#endif // COMPLETION_H
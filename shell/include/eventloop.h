@@ -0,0 +1,25 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <stdbool.h>
+
+// Called when a registered fd becomes readable or a timer expires.
+typedef void (*EventCallback)(int fd, void* data);
+
+bool event_loop_init(void);
+
+// Watches fd for input. Fds that epoll cannot watch (regular files) are
+// treated as always readable.
+bool event_loop_add_fd(int fd, EventCallback callback, void* data);
+void event_loop_remove_fd(int fd);
+
+// Arms a timerfd firing after interval_ms, and every interval_ms after that
+// if repeat is set. Returns the timer's fd, which identifies it for removal.
+int event_loop_add_timer(long interval_ms, bool repeat, EventCallback callback, void* data);
+void event_loop_remove_timer(int timer_fd);
+
+// Dispatches events until event_loop_stop() is called.
+void event_loop_run(void);
+void event_loop_stop(void);
+
+#endif // EVENTLOOP_H
@@ -3,14 +3,20 @@
 
 #include <stdbool.h>
 
-// Enum to classify built-in commands
-enum BuiltinType { NOT_BUILTIN, SPECIAL_BUILTIN, REGULAR_BUILTIN };
+// Enum to classify built-in commands. A job builtin always gets a process
+// of its own, as an external command does.
+enum BuiltinType { NOT_BUILTIN, SPECIAL_BUILTIN, REGULAR_BUILTIN, JOB_BUILTIN };
 
 // The main execution function that parses and runs commands.
 bool execute(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
 
 // These are needed by multiple modules, so they are declared here.
 enum BuiltinType get_builtin_type(const char* cmd);
-void execute_builtin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
+// The same for a command's words from its name on, which is NOT_BUILTIN
+// where a builtin leaves them to the external command of the same name.
+enum BuiltinType get_command_builtin_type(char** tokens, int token_count);
+// NULL-terminated list of builtin command names.
+const char* const* get_builtin_names(void);
+int execute_builtin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
 
 #endif // EXECUTOR_H
\ No newline at end of file
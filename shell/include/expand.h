@@ -0,0 +1,17 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stdbool.h>
+#include "argv.h"
+
+// Substitutes $NAME, ${NAME} and $?, then expands '~' and the glob patterns
+// '*', '?' and '[...]' (plus '**' for any number of directories) in every
+// token, appending the words to args. Expanded words are owned by args; the
+// others alias the input tokens. Patterns that match nothing are passed
+// through literally. Returns the new word count.
+int expand_tokens(char** tokens, int token_count, ArgVector* args, const char* home_dir);
+
+// Matches a name against a single path component pattern.
+bool glob_match(const char* pattern, const char* name);
+
+#endif // EXPAND_H
@@ -0,0 +1,14 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Starts the helper processes for `|> path...`: everything written to the
+// pipe in_fd is copied into each file and then on to out_fd, with tee(2)
+// and splice(2) so the data never passes through user space. Helpers join
+// process group pgid (0: the first helper starts one) and their pids are
+// appended to pids. The caller still owns in_fd and out_fd.
+bool start_fanout(int in_fd, char** paths, int path_count, int out_fd, pid_t* pgid, pid_t* pids, int* pid_count);
+
+#endif // FANOUT_H
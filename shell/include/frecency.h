@@ -0,0 +1,19 @@
+#ifndef FRECENCY_H
+#define FRECENCY_H
+
+#include <stdbool.h>
+
+// Visited directories, scored by how often and how recently they were
+// visited. Shared by every session through ~/.shell_dirs, which is only
+// ever appended to, and compacted once it grows.
+
+// Records a visit to dir, an absolute path.
+void frecency_visit(const char* dir);
+// The existing directory with the best score whose path contains partial
+// (ignoring case unless partial has capitals), other than exclude. NULL if
+// none matches.
+const char* frecency_best(const char* partial, const char* exclude);
+// Prints the best max directories with their scores.
+void frecency_list(int max);
+
+#endif // FRECENCY_H
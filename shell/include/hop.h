@@ -4,5 +4,14 @@
 #include <stdbool.h>
 
 bool hop(char** args, int num_args, char** prev_dir, const char* home_dir);
+// dirs prints the directory stack that `hop +N` picks from; dirs -f prints
+// the most frecent directories that `hop @partial` searches.
+bool dirs(char** args, int num_args, const char* home_dir);
+bool change_directory(const char* path, char** prev_dir);
+
+// The shell's working directory, tracked by change_directory().
+const char* current_directory(void);
+// For when the directory was changed some other way.
+void refresh_current_directory(void);
 
 #endif // HOP_H
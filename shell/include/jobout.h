@@ -0,0 +1,24 @@
+#ifndef JOBOUT_H
+#define JOBOUT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// The captured stdout and stderr of a job started with `&!`.
+typedef struct JobOutput JobOutput;
+
+// Gives the job just added as pgid a ring buffer fed from read_fd, the
+// read end of the pipe its output goes to. Takes ownership of read_fd.
+void capture_job_output(pid_t pgid, int read_fd);
+void release_job_output(JobOutput* output);
+
+// The pipe to watch while the job runs in the foreground (-1 if there is
+// none), and the matching callback: it copies new output into the ring and
+// onto the terminal, returning false at EOF.
+int job_output_fd(const JobOutput* output);
+bool show_job_output(void* output);
+
+// jobout [job_number] [-f]
+int jobout_command(char** tokens, int token_count);
+
+#endif // JOBOUT_H
@@ -3,6 +3,11 @@
 
 #include <stdbool.h>
 #include <sys/types.h>
+#include "timeout.h"
+#include "jobout.h"
+
+// Enough for a thousand background jobs.
+#define MAX_JOBS 1024
 
 // Enum for job states
 typedef enum {
@@ -16,10 +21,15 @@ typedef struct {
     pid_t pid; // This is the process group ID (pgid)
     char command_name[256];
     JobState state;
+    JobTimeout timeout;
+    JobOutput* output;    // set for a job started with &!
 } BackgroundJob;
 
 // Function declarations
-void check_background_jobs(void);
+// Reaps finished jobs and reports them; returns the number of reports.
+int check_background_jobs(void);
+// Same, for reports made asynchronously while the prompt is displayed.
+int notify_background_jobs(void);
 void list_activities(void);
 void check_and_kill_all_jobs(void);
 void remove_job_by_pid(pid_t pid);
@@ -28,7 +38,7 @@ BackgroundJob* find_job_by_number(int job_number);
 BackgroundJob* find_most_recent_job();
 const char* get_job_state_string(JobState state);
 
-extern BackgroundJob background_jobs[256];
+extern BackgroundJob background_jobs[MAX_JOBS];
 extern int background_job_count;
 
 #endif // JOBS_H
@@ -0,0 +1,29 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// What a call to line_editor_feed() produced.
+typedef enum {
+    EDIT_PENDING,   // the line is still being edited
+    EDIT_LINE,      // Enter was pressed; *line holds the finished line
+    EDIT_EOF,       // Ctrl-D on an empty line
+    EDIT_INTERRUPT  // Ctrl-C; the line was abandoned
+} EditResult;
+
+// Puts the terminal in raw mode and starts editing a new line after prompt.
+void line_editor_begin(const char* prompt);
+// Restores the terminal mode that was active before line_editor_begin().
+void line_editor_end(void);
+bool line_editor_active(void);
+
+// Processes keyboard input. Stops after the first byte that finishes the
+// line and reports how many bytes were used in *consumed. A returned line
+// is heap allocated and owned by the caller.
+EditResult line_editor_feed(const char* bytes, size_t length, size_t* consumed, char** line);
+
+// Reprints the prompt and the line being edited, e.g. after a job report.
+void line_editor_redraw(void);
+
+#endif // LINEEDIT_H
@@ -7,6 +7,13 @@ void init_log();
 
 void add_to_log(const char* command);
 
+// Reads the entries other sessions appended since the last call.
+void sync_history(void);
+
+// Read access to the stored history, oldest entry first.
+int get_history_count(void);
+const char* get_history_entry(int index);
+
 // bool handle_log_command(char** args, int num_args);
 bool handle_log_command(char** args, int num_args, char** prev_dir, const char* home_dir);
 
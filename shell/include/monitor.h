@@ -0,0 +1,12 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+// activities -w [interval [count]]
+// Redraws the background jobs every interval seconds (default 2, as in
+// watch(1)) with the threads, CPU%, RSS and elapsed time of each job and of
+// every process in its group, until Ctrl-C or count refreshes. The
+// /proc/<pid>/stat and statm of those processes stay open between refreshes
+// and are re-read with pread().
+int watch_activities(char** args, int arg_count);
+
+#endif // MONITOR_H
@@ -0,0 +1,12 @@
+#ifndef ONCHANGE_H
+#define ONCHANGE_H
+
+// onchange [-r] [-d MS] PATH... -- command [arg...]
+// Runs the command, then again each time one of the paths changes, once
+// MS milliseconds (100 by default) have passed without further changes.
+// A run still going when the next one is due is stopped first. -r also
+// watches every directory below the paths. Runs as a job of its own, so it
+// can be sent to the background and stopped with fg, bg and ping.
+int onchange_command(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
+
+#endif // ONCHANGE_H
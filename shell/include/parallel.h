@@ -0,0 +1,18 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Recognises the `[N]` and `[N:o]` words that open a data-parallel stage.
+bool parse_parallel_prefix(const char* token, int* workers, bool* ordered);
+
+// Starts the coordinator for `[N] cmd`. It cuts everything read from in_fd
+// (-1: stdin) into line-aligned chunks, feeds them to N copies of the
+// command and merges their output into out_fd (-1: stdout) a line at a
+// time. Ordered, each chunk gets a copy of its own and outputs keep input
+// order. The coordinator and its workers join process group pgid (0: the
+// coordinator starts one). Returns the coordinator's pid, or -1.
+pid_t start_parallel_stage(int in_fd, int out_fd, char** tokens, int token_count, int workers, bool ordered, pid_t* pgid, char** prev_dir, char* SHELL_HOME_DIR);
+
+#endif // PARALLEL_H
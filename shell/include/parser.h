@@ -2,8 +2,21 @@
 #define PARSER_H
 
 #include <stdbool.h>
+#include "argv.h"
+
+// Bumped whenever tokenize_input() splits or rewrites words differently,
+// which makes script.c recompile every cached script.
+#define TOKENIZER_VERSION 2
+
+// tokenize_input() puts this byte where the quoted part of a word begins.
+// expand_tokens() removes it and takes such words literally, without glob
+// expansion, and without tilde expansion if the '~' itself was quoted.
+#define QUOTED_WORD '\001'
 
 bool parse_input(char *input);
-void tokenize_input(char* line, char* tokens[], int* token_count);
+// Appends the words and operators of line to tokens, each an owned copy.
+void tokenize_input(char* line, ArgVector* tokens);
+// True for a <(command) or >(command) word.
+bool is_process_substitution(const char* token);
 
 #endif
@@ -5,6 +5,16 @@
 #include <stdbool.h>
 
 // Function declarations
-pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, const char* command_name, char** prev_dir, char* SHELL_HOME_DIR);
+// With capture_output, a background job's stdout and stderr go to a ring
+// buffer read with jobout instead of the terminal.
+pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, bool capture_output, const char* command_name, char** prev_dir, char* SHELL_HOME_DIR);
+
+// Keeps commands started from now on in the caller's process group instead
+// of giving each job its own, for a child shell that is part of a job.
+void pipeline_stay_in_process_group(void);
+
+// While enabled, a foreground external command that would be forked and
+// waited for replaces a non-interactive shell through exec instead.
+void pipeline_exec_in_place(bool enable);
 
 #endif // PIPELINE_H
@@ -0,0 +1,45 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define PLACEMENT_MAX_CPUS 1024
+
+// Where and how urgently a job runs, from `pin CPUS`, `nice [N]` and
+// `ionice CLASS[:LEVEL]` in front of a command or pipeline.
+typedef struct {
+    bool pinned;
+    unsigned long cpus[PLACEMENT_MAX_CPUS / (8 * sizeof(unsigned long))];
+    bool niced;
+    int nice;
+    int ioprio;           // class and level as for ioprio_set(), 0 for none
+} JobPlacement;
+
+// Parses one leading pin, nice or ionice prefix into placement, which
+// starts out zeroed and collects every prefix of the command. Returns the
+// number of words used, or 0 if the words do not form a prefix followed by
+// a command.
+int parse_placement(char** tokens, int token_count, JobPlacement* placement);
+bool placement_is_set(const JobPlacement* placement);
+
+// Records the placement of the job execute_pipeline() is starting. Every
+// process forked for the job calls placement_apply_in_child() before
+// running anything, which exits with 125 if it cannot be applied.
+void placement_begin_launch(const JobPlacement* placement);
+void placement_apply_in_child(void);
+
+// repin CPUS [job_number], renice N [job_number] and
+// reionice CLASS[:LEVEL] [job_number]: change every thread of a job's
+// process group, the most recent job by default.
+int repin_command(char** tokens, int token_count);
+int renice_command(char** tokens, int token_count);
+int reionice_command(char** tokens, int token_count);
+
+// For activities -w: a thread's CPUs as a list such as "0-3,6" (or "all"),
+// and its I/O class and level such as "be/4" (or "-" if it has none).
+void format_cpus(pid_t tid, char* buffer, size_t size);
+void format_ioprio(pid_t tid, char* buffer, size_t size);
+
+#endif // PLACEMENT_H
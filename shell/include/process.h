@@ -3,6 +3,32 @@
 
 #include <stdbool.h>
 
+// Stdin/stdout as they were before apply_redirections(), or -1 if untouched.
+typedef struct {
+    int saved_stdin;
+    int saved_stdout;
+} SavedFds;
+
+// Applies the <, > and >> redirections in tokens to stdin/stdout and copies
+// the other words into args. With saved non-NULL the original fds are kept
+// for restore_redirections(). Returns false, after printing an error and
+// changing nothing, if a file cannot be opened.
+bool apply_redirections(char** tokens, int token_count, char** args, int* arg_count, SavedFds* saved);
+void restore_redirections(SavedFds* saved);
+// Makes the redirections permanent, dropping the saved fds.
+void keep_redirections(SavedFds* saved);
+
+// exec [command [arg...]]: replaces the shell with command. Without one the
+// caller keeps the redirections for the rest of the session. Returns only if
+// an interactive shell cannot find the command.
+int exec_command(char** args, int arg_count);
+
+// The number of leading NAME=value words. In front of a command they are
+// added to its environment by run_command_in_child(); on their own,
+// assign_variable() sets each in the shell.
+int count_assignments(char** words, int word_count);
+void assign_variable(const char* assignment);
+
 // Function declarations
 void run_command_in_child(char** tokens, int token_count, bool run_in_background, char** prev_dir, char* SHELL_HOME_DIR);
 
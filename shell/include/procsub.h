@@ -0,0 +1,34 @@
+#ifndef PROCSUB_H
+#define PROCSUB_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "argv.h"
+
+// The pipes behind the <(cmd) and >(cmd) words of one command.
+typedef struct {
+    ArgVector args;     // the command, each substitution replaced by /dev/fd/N
+    int* outer_fds;     // N: the end the command opens through its path
+    int* inner_fds;     // the end the substituted command reads or writes
+    char** commands;    // the substituted command lines
+    bool* writes;       // true for <(cmd), whose command writes the pipe
+    int count;
+} ProcessSubstitutions;
+
+// Creates a close-on-exec pipe for every substitution in tokens and builds
+// the command's words in subs->args. Returns false if a pipe cannot be made.
+bool prepare_process_substitutions(char** tokens, int token_count, ProcessSubstitutions* subs);
+
+// Called in the command's child before exec: keeps the /dev/fd ends open
+// across exec and drops the others.
+void keep_process_substitutions(ProcessSubstitutions* subs);
+
+// Forks the substituted commands into process group pgid (0: the first one
+// starts it), appends their pids to pids and releases subs. Each runs as a
+// non-interactive shell whose own children stay in the same group.
+bool start_process_substitutions(ProcessSubstitutions* subs, pid_t* pgid, pid_t* pids, int* pid_count, char** prev_dir, char* SHELL_HOME_DIR);
+
+// Closes the pipes of substitutions that were never started.
+void free_process_substitutions(ProcessSubstitutions* subs);
+
+#endif // PROCSUB_H
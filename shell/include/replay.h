@@ -0,0 +1,22 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+
+// --record FILE: every input line is written to FILE with when it was
+// entered, the cwd it started in, how long it took to parse, tokenize and
+// run, and its exit status. main.c brackets each line with these calls,
+// which do nothing unless recording.
+bool record_open(const char* path);
+void record_begin(const char* line);
+void record_parsed(void);
+void record_tokenized(void);
+void record_end(void);
+
+// --replay FILE [--max-speed]: feeds a recorded session back through
+// parse_input() and run_tokens(), at the recorded pace unless max_speed,
+// then prints end-to-end latency percentiles and throughput for each
+// command class (the first word of the line) to stderr.
+bool run_replay(const char* path, bool max_speed, char** prev_dir, char* SHELL_HOME_DIR);
+
+#endif // REPLAY_H
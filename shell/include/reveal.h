@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 
+// Sorts names in place using the same ordering reveal prints them in.
+void sort_names(char** names, int count);
 bool reveal(char** args, int num_args, char** prev_dir, const char* home_dir);
 
 #endif // REVEAL_H
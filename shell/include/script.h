@@ -0,0 +1,10 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdbool.h>
+
+// Runs every line of a script file non-interactively. The tokenized form of
+// the script is cached on disk and reused while the file is unchanged.
+bool run_script(const char* path, char** prev_dir, char* SHELL_HOME_DIR);
+
+#endif // SCRIPT_H
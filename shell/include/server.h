@@ -0,0 +1,16 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+
+// Listens on a unix socket at path and runs a session process per client.
+// A session has its own cwd, previous directory and job table, and runs
+// commands on the stdin/stdout/stderr the client passed over the socket.
+// Only returns on error.
+bool run_server(const char* path, char** prev_dir, char* SHELL_HOME_DIR);
+
+// Connects to a server, runs each command line in turn (or, if there are
+// none, each line read from stdin) and returns the last exit status.
+int run_client(const char* path, int command_count, char** commands);
+
+#endif // SERVER_H
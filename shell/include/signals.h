@@ -1,12 +1,29 @@
 #ifndef SIGNALS_H
 #define SIGNALS_H
 
+#include <stdbool.h>
 #include <sys/types.h>
 
 // Function declarations
 void ping(pid_t pid, int signal_number);
 void handle_sigint(int signo);
 void handle_sigtstp(int signo);
-void setup_signal_handlers(void);
+
+// Blocks SIGINT/SIGTSTP/SIGCHLD and returns a signalfd delivering them.
+int setup_signal_handlers(void);
+int get_signal_fd(void);
+// Returns the next signal queued on a signalfd, or 0 if none is pending.
+int read_pending_signal(int fd);
+// Returns true (once) if Ctrl-C was pressed while the shell itself was busy,
+// e.g. running a loop of builtins.
+bool interrupt_requested(void);
+// Sleeps for up to timeout_ms. Returns true, consuming it, if Ctrl-C
+// arrives first.
+bool wait_for_interrupt(long timeout_ms);
+// Restores default dispositions and an empty mask in a forked child.
+void reset_child_signals(void);
+// Makes the caller's process group the terminal's foreground group, from a
+// child that may not be in the foreground yet.
+void claim_terminal(void);
 
 #endif // SIGNALS_H
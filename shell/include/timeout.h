@@ -0,0 +1,41 @@
+#ifndef TIMEOUT_H
+#define TIMEOUT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// A `timeout` on a job: SIGTERM to its process group at the deadline, and
+// SIGKILL grace_ms later if it is still there.
+typedef struct {
+    long long deadline;   // CLOCK_MONOTONIC milliseconds, 0 for none
+    long grace_ms;
+    bool terminated;      // SIGTERM sent
+    bool killed;          // SIGKILL sent
+} JobTimeout;
+
+// Parses a leading `timeout [-k GRACE] DURATION` off a command. Durations
+// are seconds, or take an s/m/h/d suffix, and may be fractional. Returns the
+// number of words used: 0 if there is no prefix, -1 after printing an error.
+int parse_timeout(char** tokens, int token_count, JobTimeout* timeout);
+
+// waitpid(pid, status, WUNTRACED) that enforces timeout on process group
+// pgid while it waits, with a timerfd and a SIGCHLD signalfd in the shell
+// rather than a watchdog process.
+pid_t timeout_waitpid(pid_t pid, int* status, pid_t pgid, JobTimeout* timeout);
+// The same, also calling serve(data) whenever fd is readable, until it
+// returns false.
+pid_t timeout_waitpid_serving(pid_t pid, int* status, pid_t pgid, JobTimeout* timeout, int fd, bool (*serve)(void*), void* data);
+
+// Keeps enforcing the timeout from the event loop once job pgid is in the
+// background.
+void timeout_watch_job(pid_t pgid, const JobTimeout* timeout);
+// Sends the signals that are due to background jobs, for when the event
+// loop is not running: in scripts and -c, and while a foreground command
+// runs. Returns the milliseconds until the next one, or -1 if none is left.
+long long timeout_enforce_jobs(void);
+
+// The exit status of a timed command: 124 if its timeout fired, or 137 if
+// it had to be killed, as in coreutils' timeout(1).
+int timeout_exit_code(const JobTimeout* timeout, int code);
+
+#endif // TIMEOUT_H
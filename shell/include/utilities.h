@@ -0,0 +1,19 @@
+#ifndef UTILITIES_H
+#define UTILITIES_H
+
+#include <stdbool.h>
+
+// Common utilities run as builtins, so scripts do not fork and exec a
+// binary for each one. Each returns its exit status.
+
+// echo [-neE] [word...]
+int echo_command(char** tokens, int token_count);
+// test EXPRESSION, or [ EXPRESSION ]
+int test_command(char** tokens, int token_count);
+// cat [file...], with "-" or no files meaning stdin
+int cat_command(char** tokens, int token_count);
+// False if the words after cat include an option, such as -n or -A, which
+// only the external cat has. Redirections among the words are skipped.
+bool cat_handles(char** tokens, int token_count);
+
+#endif // UTILITIES_H
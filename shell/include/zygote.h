@@ -0,0 +1,27 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define ZYGOTE_MAX 64
+
+// Forks the pool process, which forks size helper processes and passes
+// them to the shell over a socket, forking a new one each time the shell
+// takes one. Each helper waits on a unix socket for one command.
+bool zygote_pool_init(int size);
+
+// Hands an external command to an idle helper, which joins process group
+// pgid (0 for a new group), takes in_fd/out_fd as stdin/stdout (-1 keeps the
+// shell's) and applies the command's redirections before exec. Returns the
+// helper's pid, or -1 if none is ready and the caller should fork instead.
+pid_t zygote_launch(char** tokens, int token_count, bool run_in_background, pid_t pgid, int in_fd, int out_fd);
+
+// Stops refilling and lets every idle helper exit.
+void zygote_pool_shutdown(void);
+
+// Drops this process's copy of the pool, in a child that keeps running shell
+// code and must not take helpers from under the shell.
+void zygote_pool_detach(void);
+
+#endif // ZYGOTE_H
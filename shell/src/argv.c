@@ -0,0 +1,56 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/argv.h"
+
+bool arg_vector_push(ArgVector* vector, char* item, bool owned) {
+    // One slot is always kept for the terminating NULL.
+    if (vector->count + 1 >= vector->capacity) {
+        int new_capacity = vector->capacity ? vector->capacity * 2 : 16;
+        char** new_items = realloc(vector->items, new_capacity * sizeof(char*));
+        if (!new_items) {
+            perror("realloc");
+            return false;
+        }
+        vector->items = new_items;
+        bool* new_owned = realloc(vector->owned, new_capacity * sizeof(bool));
+        if (!new_owned) {
+            perror("realloc");
+            return false;
+        }
+        vector->owned = new_owned;
+        vector->capacity = new_capacity;
+    }
+    vector->items[vector->count] = item;
+    vector->owned[vector->count] = owned;
+    vector->count++;
+    vector->items[vector->count] = NULL;
+    return true;
+}
+
+bool arg_vector_push_copy(ArgVector* vector, const char* text, size_t length) {
+    char* copy = strndup(text, length);
+    if (!copy) {
+        perror("strndup");
+        return false;
+    }
+    if (!arg_vector_push(vector, copy, true)) {
+        free(copy);
+        return false;
+    }
+    return true;
+}
+
+void arg_vector_free(ArgVector* vector) {
+    for (int i = 0; i < vector->count; i++) {
+        if (vector->owned[i]) {
+            free(vector->items[i]);
+        }
+    }
+    free(vector->items);
+    free(vector->owned);
+    vector->items = NULL;
+    vector->owned = NULL;
+    vector->count = vector->capacity = 0;
+}
@@ -0,0 +1,421 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../include/ast.h"
+#include "../include/executor.h"
+#include "../include/pipeline.h"
+#include "../include/expand.h"
+#include "../include/signals.h"
+
+extern int last_exit_status;
+
+typedef struct {
+    char** tokens;
+    int count;
+    int pos;
+} TokenCursor;
+
+static const char* const keywords[] = {
+    "if", "then", "elif", "else", "fi", "for", "while", "until", "do", "done", "break", "continue", NULL
+};
+
+// Lines of a compound command that is not closed yet, joined with ';'.
+static char** pending_tokens = NULL;
+static int pending_count = 0;
+static int pending_capacity = 0;
+
+// Loop state while executing: how many loops are running, and a pending
+// break/continue that the enclosing loop still has to act on.
+static int loop_depth = 0;
+static int break_levels = 0;
+static bool continue_pending = false;
+
+static bool in_set(const char* token, const char* const* set) {
+    for (int i = 0; set != NULL && set[i] != NULL; i++) {
+        if (strcmp(token, set[i]) == 0) return true;
+    }
+    return false;
+}
+
+static const char* current(const TokenCursor* c) {
+    return c->pos < c->count ? c->tokens[c->pos] : NULL;
+}
+
+static Node* new_node(NodeType type) {
+    Node* node = calloc(1, sizeof(Node));
+    if (!node) perror("calloc");
+    else node->type = type;
+    return node;
+}
+
+void free_node_list(Node* list) {
+    while (list != NULL) {
+        Node* next = list->next;
+        free(list->tokens);
+        free_node_list(list->condition);
+        free_node_list(list->body);
+        free_node_list(list->else_branch);
+        free(list);
+        list = next;
+    }
+}
+
+static ParseStatus parse_list(TokenCursor* c, const char* const* stops, Node** out);
+
+// Consumes the keyword that closes a compound command.
+static ParseStatus expect(TokenCursor* c, const char* keyword) {
+    const char* token = current(c);
+    if (token == NULL) return PARSE_INCOMPLETE;
+    if (strcmp(token, keyword) != 0) return PARSE_ERROR;
+    c->pos++;
+    return PARSE_OK;
+}
+
+// A run of words up to a ';', or up to and including an '&' or '&!'. Pipes
+// and redirections stay inside it for execute() to handle.
+static ParseStatus parse_simple(TokenCursor* c, Node** out) {
+    int start = c->pos;
+    while (c->pos < c->count && strcmp(c->tokens[c->pos], ";") != 0) {
+        const char* token = c->tokens[c->pos++];
+        if (strcmp(token, "&") == 0 || strcmp(token, "&!") == 0) break;
+    }
+
+    Node* node = new_node(NODE_COMMAND);
+    if (!node) return PARSE_ERROR;
+    node->token_count = c->pos - start;
+    node->tokens = malloc((node->token_count + 1) * sizeof(char*));
+    if (!node->tokens) {
+        free(node);
+        return PARSE_ERROR;
+    }
+    memcpy(node->tokens, c->tokens + start, node->token_count * sizeof(char*));
+    node->tokens[node->token_count] = NULL;
+    *out = node;
+    return PARSE_OK;
+}
+
+// Parses what follows "if" or "elif", through the closing "fi".
+static ParseStatus parse_if(TokenCursor* c, Node** out) {
+    static const char* const then_stops[] = { "then", NULL };
+    static const char* const body_stops[] = { "elif", "else", "fi", NULL };
+    static const char* const else_stops[] = { "fi", NULL };
+
+    Node* node = new_node(NODE_IF);
+    if (!node) return PARSE_ERROR;
+    *out = node;
+
+    ParseStatus status = parse_list(c, then_stops, &node->condition);
+    if (status == PARSE_OK) status = expect(c, "then");
+    if (status == PARSE_OK) status = parse_list(c, body_stops, &node->body);
+    if (status != PARSE_OK) return status;
+
+    const char* token = current(c);
+    if (token == NULL) return PARSE_INCOMPLETE;
+    c->pos++;
+    if (strcmp(token, "elif") == 0) {
+        return parse_if(c, &node->else_branch);
+    }
+    if (strcmp(token, "else") == 0) {
+        status = parse_list(c, else_stops, &node->else_branch);
+        return status == PARSE_OK ? expect(c, "fi") : status;
+    }
+    return PARSE_OK; // "fi"
+}
+
+static ParseStatus parse_while(TokenCursor* c, NodeType type, Node** out) {
+    static const char* const do_stops[] = { "do", NULL };
+    static const char* const done_stops[] = { "done", NULL };
+
+    Node* node = new_node(type);
+    if (!node) return PARSE_ERROR;
+    *out = node;
+
+    ParseStatus status = parse_list(c, do_stops, &node->condition);
+    if (status == PARSE_OK) status = expect(c, "do");
+    if (status == PARSE_OK) status = parse_list(c, done_stops, &node->body);
+    if (status == PARSE_OK) status = expect(c, "done");
+    return status;
+}
+
+static bool is_valid_name(const char* name) {
+    if (!((*name >= 'a' && *name <= 'z') || (*name >= 'A' && *name <= 'Z') || *name == '_')) return false;
+    for (const char* p = name + 1; *p; p++) {
+        if (!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// for NAME [in WORD...] ; do LIST ; done
+static ParseStatus parse_for(TokenCursor* c, Node** out) {
+    static const char* const done_stops[] = { "done", NULL };
+
+    Node* node = new_node(NODE_FOR);
+    if (!node) return PARSE_ERROR;
+    *out = node;
+
+    const char* name = current(c);
+    if (name == NULL) return PARSE_INCOMPLETE;
+    if (!is_valid_name(name)) return PARSE_ERROR;
+    node->variable = c->tokens[c->pos++];
+
+    const char* token = current(c);
+    if (token != NULL && strcmp(token, "in") == 0) {
+        int start = ++c->pos;
+        while (c->pos < c->count && strcmp(c->tokens[c->pos], ";") != 0 && strcmp(c->tokens[c->pos], "do") != 0) {
+            c->pos++;
+        }
+        node->token_count = c->pos - start;
+        node->tokens = malloc((node->token_count + 1) * sizeof(char*));
+        if (!node->tokens) return PARSE_ERROR;
+        memcpy(node->tokens, c->tokens + start, node->token_count * sizeof(char*));
+        node->tokens[node->token_count] = NULL;
+    }
+
+    while (current(c) != NULL && strcmp(current(c), ";") == 0) c->pos++;
+    ParseStatus status = expect(c, "do");
+    if (status == PARSE_OK) status = parse_list(c, done_stops, &node->body);
+    if (status == PARSE_OK) status = expect(c, "done");
+    return status;
+}
+
+// Parses commands until one of the stop keywords (left unconsumed) or the
+// end of the tokens, which is only acceptable at the top level.
+static ParseStatus parse_list(TokenCursor* c, const char* const* stops, Node** out) {
+    Node* head = NULL;
+    Node** tail = &head;
+    *out = NULL;
+
+    for (;;) {
+        while (current(c) != NULL && strcmp(current(c), ";") == 0) c->pos++;
+        const char* token = current(c);
+        if (token == NULL) {
+            *out = head;
+            return stops == NULL ? PARSE_OK : PARSE_INCOMPLETE;
+        }
+        if (in_set(token, stops)) {
+            *out = head;
+            return PARSE_OK;
+        }
+
+        Node* node = NULL;
+        ParseStatus status = PARSE_OK;
+        bool compound = true;
+        if (strcmp(token, "if") == 0) {
+            c->pos++;
+            status = parse_if(c, &node);
+        } else if (strcmp(token, "while") == 0 || strcmp(token, "until") == 0) {
+            c->pos++;
+            status = parse_while(c, token[0] == 'w' ? NODE_WHILE : NODE_UNTIL, &node);
+        } else if (strcmp(token, "for") == 0) {
+            c->pos++;
+            status = parse_for(c, &node);
+        } else if (strcmp(token, "break") == 0 || strcmp(token, "continue") == 0) {
+            c->pos++;
+            node = new_node(token[0] == 'b' ? NODE_BREAK : NODE_CONTINUE);
+            if (!node) status = PARSE_ERROR;
+        } else if (in_set(token, keywords)) {
+            status = PARSE_ERROR;
+        } else {
+            compound = false;
+            status = parse_simple(c, &node);
+        }
+
+        // A compound command has to be followed by a separator.
+        if (status == PARSE_OK && compound && current(c) != NULL &&
+            strcmp(current(c), ";") != 0 && !in_set(current(c), stops)) {
+            status = PARSE_ERROR;
+        }
+        if (node != NULL) {
+            *tail = node;
+            tail = &node->next;
+        }
+        if (status != PARSE_OK) {
+            free_node_list(head);
+            return status;
+        }
+    }
+}
+
+ParseStatus parse_command_list(char** tokens, int token_count, Node** list) {
+    TokenCursor cursor = { tokens, token_count, 0 };
+    return parse_list(&cursor, NULL, list);
+}
+
+// tail: nothing runs after this command, so it may exec in place of the
+// shell.
+static void run_command(Node* node, bool tail, char** prev_dir, char* SHELL_HOME_DIR) {
+    ArgVector args = ARG_VECTOR_INIT;
+    expand_tokens(node->tokens, node->token_count, &args, SHELL_HOME_DIR);
+    pipeline_exec_in_place(tail);
+    execute(args.items, args.count, prev_dir, SHELL_HOME_DIR);
+    pipeline_exec_in_place(false);
+    arg_vector_free(&args);
+}
+
+static bool loop_should_stop(void) {
+    return break_levels > 0 || continue_pending;
+}
+
+// Called after each loop body. Returns true if the loop has to end.
+static bool loop_finish_iteration(void) {
+    // A command killed by Ctrl-C, or Ctrl-C while builtins ran in the shell,
+    // ends every enclosing loop.
+    if (last_exit_status == 130 || interrupt_requested()) {
+        break_levels = loop_depth;
+    }
+    continue_pending = false;
+    if (break_levels > 0) {
+        break_levels--;
+        return true;
+    }
+    return false;
+}
+
+static void run_loop(Node* node, char** prev_dir, char* SHELL_HOME_DIR) {
+    loop_depth++;
+    if (node->type == NODE_FOR) {
+        ArgVector words = ARG_VECTOR_INIT;
+        expand_tokens(node->tokens, node->token_count, &words, SHELL_HOME_DIR);
+        for (int i = 0; i < words.count; i++) {
+            setenv(node->variable, words.items[i], 1);
+            execute_node_list(node->body, prev_dir, SHELL_HOME_DIR);
+            if (loop_finish_iteration()) break;
+        }
+        arg_vector_free(&words);
+    } else {
+        for (;;) {
+            execute_node_list(node->condition, prev_dir, SHELL_HOME_DIR);
+            if (loop_should_stop() && loop_finish_iteration()) break;
+            bool condition_holds = (last_exit_status == 0);
+            if (condition_holds != (node->type == NODE_WHILE)) {
+                last_exit_status = 0;
+                break;
+            }
+            execute_node_list(node->body, prev_dir, SHELL_HOME_DIR);
+            if (loop_finish_iteration()) break;
+        }
+    }
+    loop_depth--;
+}
+
+// With tail set the list is the last thing the shell runs, and so is its
+// final command (or the final command of the branch an if takes). Loop
+// bodies never are.
+static int run_list(Node* list, bool tail, char** prev_dir, char* SHELL_HOME_DIR) {
+    for (Node* node = list; node != NULL && !loop_should_stop(); node = node->next) {
+        bool last = tail && node->next == NULL;
+        switch (node->type) {
+            case NODE_COMMAND:
+                run_command(node, last, prev_dir, SHELL_HOME_DIR);
+                break;
+            case NODE_IF:
+                run_list(node->condition, false, prev_dir, SHELL_HOME_DIR);
+                if (loop_should_stop()) break;
+                if (last_exit_status == 0) {
+                    run_list(node->body, last, prev_dir, SHELL_HOME_DIR);
+                } else if (node->else_branch != NULL) {
+                    run_list(node->else_branch, last, prev_dir, SHELL_HOME_DIR);
+                } else {
+                    last_exit_status = 0;
+                }
+                break;
+            case NODE_WHILE:
+            case NODE_UNTIL:
+            case NODE_FOR:
+                run_loop(node, prev_dir, SHELL_HOME_DIR);
+                break;
+            case NODE_BREAK:
+            case NODE_CONTINUE:
+                if (loop_depth == 0) {
+                    fprintf(stderr, "%s: only meaningful in a loop\n", node->type == NODE_BREAK ? "break" : "continue");
+                    last_exit_status = 1;
+                } else if (node->type == NODE_BREAK) {
+                    break_levels = 1;
+                } else {
+                    continue_pending = true;
+                }
+                break;
+        }
+    }
+    return last_exit_status;
+}
+
+int execute_node_list(Node* list, char** prev_dir, char* SHELL_HOME_DIR) {
+    return run_list(list, false, prev_dir, SHELL_HOME_DIR);
+}
+
+static bool pending_append(const char* token) {
+    if (pending_count == pending_capacity) {
+        int new_capacity = pending_capacity ? pending_capacity * 2 : 64;
+        char** new_tokens = realloc(pending_tokens, new_capacity * sizeof(char*));
+        if (!new_tokens) return false;
+        pending_tokens = new_tokens;
+        pending_capacity = new_capacity;
+    }
+    pending_tokens[pending_count] = strdup(token);
+    if (!pending_tokens[pending_count]) return false;
+    pending_count++;
+    return true;
+}
+
+static void free_tokens(char** tokens, int count) {
+    for (int i = 0; i < count; i++) {
+        free(tokens[i]);
+    }
+    free(tokens);
+}
+
+static void run_line(char** tokens, int token_count, bool last_line, char** prev_dir, char* SHELL_HOME_DIR) {
+    if (pending_count > 0) {
+        // Continue the open compound command on a new line.
+        pending_append(";");
+        for (int i = 0; i < token_count; i++) {
+            pending_append(tokens[i]);
+        }
+        tokens = pending_tokens;
+        token_count = pending_count;
+    }
+
+    Node* list = NULL;
+    ParseStatus status = parse_command_list(tokens, token_count, &list);
+    if (status == PARSE_INCOMPLETE) {
+        if (pending_count == 0) {
+            for (int i = 0; i < token_count; i++) {
+                pending_append(tokens[i]);
+            }
+        }
+        return;
+    }
+
+    // Detach the pending lines before running them: a command such as
+    // `log execute` may re-enter run_tokens().
+    char** owned_tokens = pending_tokens;
+    int owned_count = pending_count;
+    pending_tokens = NULL;
+    pending_count = pending_capacity = 0;
+
+    if (status == PARSE_ERROR) {
+        printf("Invalid Syntax!\n");
+        last_exit_status = 2;
+    } else {
+        run_list(list, last_line, prev_dir, SHELL_HOME_DIR);
+        free_node_list(list);
+    }
+    free_tokens(owned_tokens, owned_count);
+}
+
+void run_tokens(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    run_line(tokens, token_count, false, prev_dir, SHELL_HOME_DIR);
+}
+
+void run_last_tokens(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    run_line(tokens, token_count, true, prev_dir, SHELL_HOME_DIR);
+}
+
+bool command_pending(void) {
+    return pending_count > 0;
+}
@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/pidfd.h>
+#include "../include/batch.h"
+#include "../include/argv.h"
+#include "../include/signals.h"
+
+// Linux refuses any single argument longer than this (MAX_ARG_STRLEN).
+#define MAX_ITEM_LENGTH (32 * 4096)
+// Room left for the auxiliary vector and the executable name.
+#define ARG_HEADROOM 4096
+#define MAX_PARALLEL 256
+
+typedef struct {
+    pid_t pids[MAX_PARALLEL];
+    int pidfds[MAX_PARALLEL];
+    int running;
+    int parallel;
+    bool failed;
+    bool interrupted;
+} BatchRuns;
+
+// Bytes an argument occupies on the new process's stack.
+static size_t arg_cost(const char* arg) {
+    return strlen(arg) + 1 + sizeof(char*);
+}
+
+static void record_status(BatchRuns* runs, int status) {
+    if (WIFSIGNALED(status)) {
+        runs->failed = true;
+        if (WTERMSIG(status) == SIGINT) runs->interrupted = true;
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        runs->failed = true;
+    }
+}
+
+// Waits for one run to finish. Polls pidfds rather than waitpid(-1) so the
+// shell's own background jobs are never reaped here.
+static void wait_for_one(BatchRuns* runs) {
+    struct pollfd fds[MAX_PARALLEL];
+    for (int i = 0; i < runs->running; i++) {
+        fds[i].fd = runs->pidfds[i];
+        fds[i].events = POLLIN;
+    }
+    if (poll(fds, (nfds_t)runs->running, -1) == -1 && errno != EINTR) {
+        perror("batch: poll");
+    }
+    for (int i = 0; i < runs->running; i++) {
+        if (fds[i].revents == 0) continue;
+        int status;
+        if (waitpid(runs->pids[i], &status, 0) == -1) continue;
+        record_status(runs, status);
+        close(runs->pidfds[i]);
+        runs->running--;
+        runs->pids[i] = runs->pids[runs->running];
+        runs->pidfds[i] = runs->pidfds[runs->running];
+        return;
+    }
+}
+
+static void launch(BatchRuns* runs, char** argv) {
+    while (runs->running >= runs->parallel) {
+        wait_for_one(runs);
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("batch: fork");
+        runs->failed = true;
+        return;
+    }
+    if (pid == 0) {
+        reset_child_signals();
+        execvp(argv[0], argv);
+        fprintf(stderr, "Command not found!\n");
+        _exit(127);
+    }
+
+    int pidfd = pidfd_open(pid, 0);
+    if (pidfd == -1) {
+        // No pidfd: run this one to completion instead.
+        int status;
+        if (waitpid(pid, &status, 0) != -1) record_status(runs, status);
+        return;
+    }
+    runs->pids[runs->running] = pid;
+    runs->pidfds[runs->running] = pidfd;
+    runs->running++;
+}
+
+// Sums what the environment and the fixed arguments take from ARG_MAX.
+static size_t available_arg_space(char** fixed, int fixed_count) {
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0) arg_max = 128 * 1024;
+    size_t used = ARG_HEADROOM;
+    for (char** env = environ; *env != NULL; env++) {
+        used += arg_cost(*env);
+    }
+    for (int i = 0; i < fixed_count; i++) {
+        used += arg_cost(fixed[i]);
+    }
+    return (size_t)arg_max > used ? (size_t)arg_max - used : 0;
+}
+
+int batch_command(char** args, int arg_count) {
+    int parallel = 1;
+    long max_items = 0;
+    char separator = '\n';
+    int i = 1;
+    for (; i < arg_count && args[i][0] == '-'; i++) {
+        if (strcmp(args[i], "-0") == 0) {
+            separator = '\0';
+        } else if (strcmp(args[i], "-P") == 0 && i + 1 < arg_count) {
+            parallel = atoi(args[++i]);
+            if (parallel <= 0) parallel = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        } else if (strcmp(args[i], "-n") == 0 && i + 1 < arg_count) {
+            max_items = atol(args[++i]);
+        } else {
+            break;
+        }
+    }
+    if (i >= arg_count) {
+        fprintf(stderr, "Syntax: batch [-P N] [-n MAX] [-0] command [arg...]\n");
+        return 1;
+    }
+    if (parallel < 1) parallel = 1;
+    if (parallel > MAX_PARALLEL) parallel = MAX_PARALLEL;
+
+    BatchRuns runs;
+    memset(&runs, 0, sizeof(runs));
+    runs.parallel = parallel;
+
+    ArgVector argv = ARG_VECTOR_INIT;
+    int fixed_count = arg_count - i;
+    for (int j = i; j < arg_count; j++) {
+        arg_vector_push(&argv, args[j], false);
+    }
+    size_t space = available_arg_space(args + i, fixed_count);
+    size_t used = 0;
+
+    char buffer[65536];
+    char* partial = NULL;
+    size_t partial_length = 0;
+    bool done = false;
+    while (!done && !runs.interrupted) {
+        ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) perror("batch: read");
+        if (n <= 0) {
+            done = true;
+            n = 0;
+            if (partial_length == 0) break;
+        }
+
+        // The end of input also ends an unterminated last item.
+        size_t start = 0;
+        for (size_t k = 0; k <= (size_t)n; k++) {
+            if (k < (size_t)n && buffer[k] != separator) continue;
+            if (k == (size_t)n && !done) break;
+
+            char* item;
+            size_t length = k - start;
+            if (partial_length > 0) {
+                char* joined = realloc(partial, partial_length + length + 1);
+                if (!joined) break;
+                memcpy(joined + partial_length, buffer + start, length);
+                joined[partial_length + length] = '\0';
+                item = joined;
+                partial = NULL;
+                partial_length = 0;
+            } else {
+                item = strndup(buffer + start, length);
+            }
+            start = k + 1;
+            if (!item || item[0] == '\0' || strlen(item) >= MAX_ITEM_LENGTH) {
+                if (item && item[0] != '\0') {
+                    fprintf(stderr, "batch: argument too long\n");
+                    runs.failed = true;
+                }
+                free(item);
+                continue;
+            }
+
+            size_t cost = arg_cost(item);
+            int items = argv.count - fixed_count;
+            if (items > 0 && (used + cost > space || (max_items > 0 && items >= max_items))) {
+                launch(&runs, argv.items);
+                arg_vector_free(&argv);
+                for (int j = i; j < arg_count; j++) {
+                    arg_vector_push(&argv, args[j], false);
+                }
+                used = 0;
+                if (interrupt_requested()) runs.interrupted = true;
+            }
+            arg_vector_push(&argv, item, true);
+            used += cost;
+        }
+
+        // Keep an item cut off at the end of the buffer for the next read.
+        if (!done && start < (size_t)n) {
+            char* grown = realloc(partial, partial_length + (size_t)n - start + 1);
+            if (grown) {
+                memcpy(grown + partial_length, buffer + start, (size_t)n - start);
+                partial = grown;
+                partial_length += (size_t)n - start;
+            }
+        }
+    }
+    free(partial);
+
+    if (argv.count > fixed_count && !runs.interrupted) {
+        launch(&runs, argv.items);
+    }
+    arg_vector_free(&argv);
+    while (runs.running > 0) {
+        wait_for_one(&runs);
+    }
+    if (runs.interrupted) return 130;
+    return runs.failed ? 123 : 0;
+}
@@ -0,0 +1,395 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../include/completion.h"
+#include "../include/executor.h"
+
+extern char SHELL_HOME_DIR[];
+
+// Executables on $PATH are kept in a prefix trie. Each terminal counts how
+// many PATH directories provide that name, so a directory can be rescanned
+// on its own: its old names are removed and its new ones inserted, and the
+// rest of the trie is left untouched.
+typedef struct TrieNode {
+    struct TrieNode* child;    // first child; siblings are sorted by ch
+    struct TrieNode* sibling;
+    unsigned int terminal_count;
+    unsigned int subtree_count; // distinct names in this subtree, to skip dead branches
+    unsigned char ch;
+} TrieNode;
+
+typedef struct {
+    char* path;
+    struct timespec mtime;
+    char** names;
+    int name_count;
+    bool seen;
+} PathDir;
+
+static TrieNode trie_root;
+static pthread_mutex_t trie_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool refresh_running = false;
+
+// Only the (single) refresh thread touches these.
+static PathDir* path_dirs = NULL;
+static int path_dir_count = 0;
+
+static TrieNode* trie_child(TrieNode* node, unsigned char ch, bool create) {
+    TrieNode** link = &node->child;
+    while (*link != NULL && (*link)->ch < ch) {
+        link = &(*link)->sibling;
+    }
+    if (*link != NULL && (*link)->ch == ch) {
+        return *link;
+    }
+    if (!create) return NULL;
+
+    TrieNode* child = calloc(1, sizeof(TrieNode));
+    if (!child) return NULL;
+    child->ch = ch;
+    child->sibling = *link;
+    *link = child;
+    return child;
+}
+
+static void trie_insert(const char* name) {
+    TrieNode* path[NAME_MAX + 2];
+    int depth = 0;
+    TrieNode* node = &trie_root;
+    path[depth++] = node;
+    for (const unsigned char* p = (const unsigned char*)name; *p && depth < NAME_MAX + 1; p++) {
+        node = trie_child(node, *p, true);
+        if (!node) return;
+        path[depth++] = node;
+    }
+    if (node->terminal_count++ > 0) return;
+    for (int i = 0; i < depth; i++) {
+        path[i]->subtree_count++;
+    }
+}
+
+static void trie_remove(const char* name) {
+    TrieNode* path[NAME_MAX + 2];
+    int depth = 0;
+    TrieNode* node = &trie_root;
+    path[depth++] = node;
+    for (const unsigned char* p = (const unsigned char*)name; *p && depth < NAME_MAX + 1; p++) {
+        node = trie_child(node, *p, false);
+        if (!node) return;
+        path[depth++] = node;
+    }
+    if (node->terminal_count == 0 || --node->terminal_count > 0) return;
+    for (int i = 0; i < depth; i++) {
+        path[i]->subtree_count--;
+    }
+}
+
+// Shortens list->common to the prefix it shares with candidate.
+static void update_common(CompletionList* list, const char* candidate) {
+    if (list->common == NULL) {
+        list->common = strdup(candidate);
+        return;
+    }
+    size_t i = 0;
+    while (list->common[i] != '\0' && list->common[i] == candidate[i]) i++;
+    list->common[i] = '\0';
+}
+
+static bool list_add(CompletionList* list, const char* candidate) {
+    if (list->count >= COMPLETION_LIMIT) return false;
+    if (list->count == list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 32;
+        char** new_items = realloc(list->items, new_capacity * sizeof(char*));
+        if (!new_items) return false;
+        list->items = new_items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count] = strdup(candidate);
+    if (!list->items[list->count]) return false;
+    list->count++;
+    return true;
+}
+
+static void trie_collect(const TrieNode* node, char* buffer, int depth, CompletionList* list) {
+    if (list->count >= COMPLETION_LIMIT) return;
+    if (node->terminal_count > 0) {
+        buffer[depth] = '\0';
+        list_add(list, buffer);
+    }
+    if (depth >= NAME_MAX) return;
+    for (const TrieNode* child = node->child; child != NULL; child = child->sibling) {
+        if (child->subtree_count == 0) continue;
+        buffer[depth] = (char)child->ch;
+        trie_collect(child, buffer, depth + 1, list);
+    }
+}
+
+// Extends buffer with the characters every name below node shares: follow
+// the only live child until a name ends or the names diverge.
+static int trie_common_prefix(const TrieNode* node, char* buffer, int depth) {
+    while (node->terminal_count == 0 && depth < NAME_MAX) {
+        const TrieNode* only = NULL;
+        for (const TrieNode* child = node->child; child != NULL; child = child->sibling) {
+            if (child->subtree_count == 0) continue;
+            if (only != NULL) return depth;
+            only = child;
+        }
+        if (only == NULL) return depth;
+        buffer[depth++] = (char)only->ch;
+        node = only;
+    }
+    return depth;
+}
+
+static void scan_directory(PathDir* dir) {
+    dir->names = NULL;
+    dir->name_count = 0;
+    DIR* d = opendir(dir->path);
+    if (!d) return;
+
+    int capacity = 0;
+    int dfd = dirfd(d);
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        struct stat st;
+        if (fstatat(dfd, entry->d_name, &st, 0) != 0) continue;
+        if (!S_ISREG(st.st_mode) || !(st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) continue;
+
+        if (dir->name_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char** new_names = realloc(dir->names, capacity * sizeof(char*));
+            if (!new_names) break;
+            dir->names = new_names;
+        }
+        dir->names[dir->name_count] = strdup(entry->d_name);
+        if (dir->names[dir->name_count]) dir->name_count++;
+    }
+    closedir(d);
+}
+
+static void drop_directory_names(PathDir* dir) {
+    pthread_mutex_lock(&trie_mutex);
+    for (int i = 0; i < dir->name_count; i++) {
+        trie_remove(dir->names[i]);
+    }
+    pthread_mutex_unlock(&trie_mutex);
+    for (int i = 0; i < dir->name_count; i++) {
+        free(dir->names[i]);
+    }
+    free(dir->names);
+    dir->names = NULL;
+    dir->name_count = 0;
+}
+
+static void update_directory(const char* path) {
+    PathDir* dir = NULL;
+    for (int i = 0; i < path_dir_count; i++) {
+        if (strcmp(path_dirs[i].path, path) == 0) {
+            dir = &path_dirs[i];
+            break;
+        }
+    }
+
+    struct stat st;
+    bool exists = (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+    if (dir != NULL) {
+        dir->seen = true;
+        if (exists && dir->mtime.tv_sec == st.st_mtim.tv_sec && dir->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            return;
+        }
+        drop_directory_names(dir);
+    } else {
+        PathDir* new_dirs = realloc(path_dirs, (path_dir_count + 1) * sizeof(PathDir));
+        if (!new_dirs) return;
+        path_dirs = new_dirs;
+        dir = &path_dirs[path_dir_count];
+        memset(dir, 0, sizeof(*dir));
+        dir->path = strdup(path);
+        if (!dir->path) return;
+        dir->seen = true;
+        path_dir_count++;
+    }
+
+    if (!exists) {
+        dir->mtime.tv_sec = -1;
+        return;
+    }
+    dir->mtime = st.st_mtim;
+    scan_directory(dir);
+
+    pthread_mutex_lock(&trie_mutex);
+    for (int i = 0; i < dir->name_count; i++) {
+        trie_insert(dir->names[i]);
+    }
+    pthread_mutex_unlock(&trie_mutex);
+}
+
+static void* refresh_thread(void* arg) {
+    char* path_env = arg;
+
+    for (int i = 0; i < path_dir_count; i++) {
+        path_dirs[i].seen = false;
+    }
+
+    char* saveptr;
+    for (char* dir = strtok_r(path_env, ":", &saveptr); dir != NULL; dir = strtok_r(NULL, ":", &saveptr)) {
+        update_directory(dir);
+    }
+
+    // Directories that left $PATH take their names with them.
+    for (int i = 0; i < path_dir_count; ) {
+        if (!path_dirs[i].seen) {
+            drop_directory_names(&path_dirs[i]);
+            free(path_dirs[i].path);
+            path_dirs[i] = path_dirs[--path_dir_count];
+        } else {
+            i++;
+        }
+    }
+    free(path_env);
+
+    pthread_mutex_lock(&trie_mutex);
+    refresh_running = false;
+    pthread_mutex_unlock(&trie_mutex);
+    return NULL;
+}
+
+void path_index_refresh(void) {
+    const char* path = getenv("PATH");
+    char* path_env = strdup(path ? path : "");
+    if (!path_env) return;
+
+    pthread_mutex_lock(&trie_mutex);
+    if (refresh_running) {
+        pthread_mutex_unlock(&trie_mutex);
+        free(path_env);
+        return;
+    }
+    refresh_running = true;
+    pthread_mutex_unlock(&trie_mutex);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, refresh_thread, path_env) != 0) {
+        free(path_env);
+        pthread_mutex_lock(&trie_mutex);
+        refresh_running = false;
+        pthread_mutex_unlock(&trie_mutex);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void complete_command(const char* word, CompletionList* list) {
+    const char* const* builtins = get_builtin_names();
+    for (int i = 0; builtins[i] != NULL; i++) {
+        if (strncmp(builtins[i], word, strlen(word)) == 0 && get_builtin_type(builtins[i]) != NOT_BUILTIN) {
+            list_add(list, builtins[i]);
+            update_common(list, builtins[i]);
+            list->total++;
+        }
+    }
+
+    char buffer[NAME_MAX + 1];
+    size_t length = strlen(word);
+    if (length > NAME_MAX) return;
+
+    // Only the first COMPLETION_LIMIT names are copied out; the count and
+    // the shared prefix come straight from the trie, so the cost does not
+    // grow with the number of matches.
+    pthread_mutex_lock(&trie_mutex);
+    TrieNode* node = &trie_root;
+    for (size_t i = 0; i < length && node != NULL; i++) {
+        node = trie_child(node, (unsigned char)word[i], false);
+    }
+    if (node != NULL && node->subtree_count > 0) {
+        memcpy(buffer, word, length);
+        trie_collect(node, buffer, (int)length, list);
+        int common_length = trie_common_prefix(node, buffer, (int)length);
+        buffer[common_length] = '\0';
+        update_common(list, buffer);
+        list->total += (int)node->subtree_count;
+    }
+    pthread_mutex_unlock(&trie_mutex);
+}
+
+static void complete_file(const char* word, CompletionList* list) {
+    const char* slash = strrchr(word, '/');
+    const char* base = slash ? slash + 1 : word;
+    size_t dir_length = slash ? (size_t)(slash - word) + 1 : 0;
+
+    char dir_path[PATH_MAX];
+    if (dir_length == 0) {
+        strcpy(dir_path, ".");
+    } else if (word[0] == '~' && (word[1] == '/' || word[1] == '\0')) {
+        snprintf(dir_path, sizeof(dir_path), "%s%.*s", SHELL_HOME_DIR, (int)(dir_length - 1), word + 1);
+    } else {
+        snprintf(dir_path, sizeof(dir_path), "%.*s", (int)dir_length, word);
+    }
+
+    DIR* d = opendir(dir_path);
+    if (!d) return;
+    int dfd = dirfd(d);
+    size_t base_length = strlen(base);
+    struct dirent* entry;
+    char candidate[PATH_MAX];
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (entry->d_name[0] == '.' && base[0] != '.') continue;
+        if (strncmp(entry->d_name, base, base_length) != 0) continue;
+
+        struct stat st;
+        bool is_dir = (fstatat(dfd, entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+        snprintf(candidate, sizeof(candidate), "%.*s%s%s", (int)dir_length, word, entry->d_name, is_dir ? "/" : "");
+        list_add(list, candidate);
+        update_common(list, candidate);
+        list->total++;
+    }
+    closedir(d);
+}
+
+static int compare_candidates(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+void complete_word(const char* word, bool command_position, CompletionList* list) {
+    if (command_position && strchr(word, '/') == NULL) {
+        complete_command(word, list);
+    } else {
+        complete_file(word, list);
+    }
+
+    qsort(list->items, list->count, sizeof(char*), compare_candidates);
+    int unique = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (unique > 0 && strcmp(list->items[unique - 1], list->items[i]) == 0) {
+            // A builtin that is also on $PATH was counted twice.
+            free(list->items[i]);
+            list->total--;
+        } else {
+            list->items[unique++] = list->items[i];
+        }
+    }
+    list->count = unique;
+}
+
+void free_completion_list(CompletionList* list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i]);
+    }
+    free(list->items);
+    free(list->common);
+    list->items = NULL;
+    list->common = NULL;
+    list->count = list->capacity = list->total = 0;
+}
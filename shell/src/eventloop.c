@@ -0,0 +1,197 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "../include/eventloop.h"
+
+#define MAX_EVENTS 32
+
+typedef struct EventSource {
+    int fd;
+    EventCallback callback;
+    void* data;
+    bool is_timer;
+    bool repeat;
+    bool always_ready;
+    bool removed;
+    struct EventSource* next;
+    struct EventSource* retired_next;
+} EventSource;
+
+static int epoll_fd = -1;
+static bool stop_requested = false;
+static EventSource* sources = NULL;
+// Sources removed while events were being dispatched are freed only after
+// the batch, since later events in the same batch may still point at them.
+static EventSource* removed_sources = NULL;
+
+bool event_loop_init(void) {
+    if (epoll_fd != -1) return true;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror("epoll_create1");
+        return false;
+    }
+    return true;
+}
+
+static EventSource* add_source(int fd, EventCallback callback, void* data) {
+    if (!event_loop_init()) return NULL;
+
+    EventSource* source = calloc(1, sizeof(EventSource));
+    if (!source) {
+        perror("event loop: calloc");
+        return NULL;
+    }
+    source->fd = fd;
+    source->callback = callback;
+    source->data = data;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = source;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        if (errno != EPERM) {
+            perror("epoll_ctl");
+            free(source);
+            return NULL;
+        }
+        source->always_ready = true;
+    }
+
+    source->next = sources;
+    sources = source;
+    return source;
+}
+
+static EventSource* unlink_source(int fd) {
+    for (EventSource** link = &sources; *link != NULL; link = &(*link)->next) {
+        if ((*link)->fd == fd) {
+            EventSource* source = *link;
+            *link = source->next;
+            return source;
+        }
+    }
+    return NULL;
+}
+
+static void retire_source(EventSource* source) {
+    if (!source->always_ready) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    }
+    if (source->is_timer) {
+        close(source->fd);
+    }
+    source->removed = true;
+    source->retired_next = removed_sources;
+    removed_sources = source;
+}
+
+bool event_loop_add_fd(int fd, EventCallback callback, void* data) {
+    return add_source(fd, callback, data) != NULL;
+}
+
+void event_loop_remove_fd(int fd) {
+    EventSource* source = unlink_source(fd);
+    if (source) retire_source(source);
+}
+
+int event_loop_add_timer(long interval_ms, bool repeat, EventCallback callback, void* data) {
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = interval_ms / 1000;
+    spec.it_value.tv_nsec = (interval_ms % 1000) * 1000000L;
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1; // a zero value would disarm the timer
+    }
+    if (repeat) spec.it_interval = spec.it_value;
+    if (timerfd_settime(timer_fd, 0, &spec, NULL) == -1) {
+        perror("timerfd_settime");
+        close(timer_fd);
+        return -1;
+    }
+
+    EventSource* source = add_source(timer_fd, callback, data);
+    if (!source) {
+        close(timer_fd);
+        return -1;
+    }
+    source->is_timer = true;
+    source->repeat = repeat;
+    return timer_fd;
+}
+
+void event_loop_remove_timer(int timer_fd) {
+    event_loop_remove_fd(timer_fd);
+}
+
+static void dispatch(EventSource* source) {
+    if (source->removed) return;
+    if (source->is_timer) {
+        uint64_t expirations;
+        if (read(source->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            return;
+        }
+        if (!source->repeat) {
+            // One-shot timers retire before the callback so it may re-arm.
+            int fd = source->fd;
+            EventCallback callback = source->callback;
+            void* data = source->data;
+            retire_source(unlink_source(fd));
+            callback(fd, data);
+            return;
+        }
+    }
+    source->callback(source->fd, source->data);
+}
+
+void event_loop_run(void) {
+    struct epoll_event events[MAX_EVENTS];
+    stop_requested = false;
+
+    while (!stop_requested) {
+        bool have_ready = false;
+        for (EventSource* source = sources; source != NULL; source = source->next) {
+            if (source->always_ready) have_ready = true;
+        }
+
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, have_ready ? 0 : -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return;
+        }
+
+        for (int i = 0; i < n && !stop_requested; i++) {
+            dispatch((EventSource*)events[i].data.ptr);
+        }
+        for (EventSource* source = sources; source != NULL && !stop_requested; ) {
+            EventSource* next = source->next;
+            if (source->always_ready && !source->removed) dispatch(source);
+            source = next;
+        }
+
+        while (removed_sources != NULL) {
+            EventSource* source = removed_sources;
+            removed_sources = source->retired_next;
+            free(source);
+        }
+    }
+}
+
+void event_loop_stop(void) {
+    stop_requested = true;
+}
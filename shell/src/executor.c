@@ -6,48 +6,212 @@
 #include "../include/executor.h"
 #include "../include/pipeline.h"
 #include "../include/jobs.h"
+#include "../include/timeout.h"
 #include "../include/hop.h"
 #include "../include/reveal.h"
 #include "../include/log.h"
 #include "../include/fg_bg.h"
 #include "../include/signals.h"
+#include "../include/batch.h"
+#include "../include/monitor.h"
+#include "../include/jobout.h"
+#include "../include/utilities.h"
+#include "../include/process.h"
+#include "../include/placement.h"
+#include "../include/onchange.h"
 
 // Global variables defined in main.c, declared here for use
 extern pid_t foreground_pid;
 extern bool is_interactive_mode;
 
-enum BuiltinType get_builtin_type(const char* cmd) {
-    if (!cmd) return NOT_BUILTIN;
-    if (strcmp(cmd, "hop") == 0 || strcmp(cmd, "exit") == 0 || strcmp(cmd, "fg") == 0 || strcmp(cmd, "bg") == 0 || strcmp(cmd, "log") == 0) {
-        return SPECIAL_BUILTIN;
-    }
-    if (strcmp(cmd, "reveal") == 0 || strcmp(cmd, "activities") == 0 || strcmp(cmd, "ping") == 0) {
-        return REGULAR_BUILTIN;
+// Every name get_builtin_type() recognises, for completion.
+static const char* const builtin_names[] = {
+    "hop", "exit", "fg", "bg", "log", "reveal", "activities", "ping", "batch", "timeout", "jobout",
+    "echo", "true", "false", "test", "[", "cat", "exec", "pin", "nice", "ionice", "repin", "renice", "reionice", "dirs", "onchange", NULL
+};
+
+const char* const* get_builtin_names(void) {
+    return builtin_names;
+}
+
+typedef int (*BuiltinHandler)(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
+
+typedef struct {
+    const char* name;
+    enum BuiltinType type;
+    BuiltinHandler run;
+} Builtin;
+
+static int run_hop(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    return hop(&tokens[1], token_count - 1, prev_dir, SHELL_HOME_DIR) ? 0 : 1;
+}
+
+static int run_dirs(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir;
+    return dirs(&tokens[1], token_count - 1, SHELL_HOME_DIR) ? 0 : 1;
+}
+
+static int run_exit(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)tokens; (void)token_count; (void)prev_dir; (void)SHELL_HOME_DIR;
+    check_and_kill_all_jobs();
+    printf("logout\n");
+    exit(0);
+}
+
+static int run_fg(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    fg_command(tokens, token_count);
+    return 0;
+}
+
+static int run_bg(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    bg_command(tokens, token_count);
+    return 0;
+}
+
+static int run_exec(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return exec_command(tokens, token_count);
+}
+
+static int run_reveal(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    return reveal(&tokens[1], token_count - 1, prev_dir, SHELL_HOME_DIR) ? 0 : 1;
+}
+
+static int run_log(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    return handle_log_command(&tokens[1], token_count - 1, prev_dir, SHELL_HOME_DIR) ? 0 : 1;
+}
+
+static int run_activities(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    if (token_count > 1 && strcmp(tokens[1], "-w") == 0) {
+        return watch_activities(&tokens[2], token_count - 2);
     }
-    return NOT_BUILTIN;
-}
-
-void execute_builtin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
-    if (strcmp(tokens[0], "hop") == 0) {
-        hop(&tokens[1], token_count - 1, prev_dir, SHELL_HOME_DIR);
-    } else if (strcmp(tokens[0], "exit") == 0) {
-        check_and_kill_all_jobs();
-        printf("logout\n");
-        exit(0);
-    } else if (strcmp(tokens[0], "fg") == 0) {
-        fg_command(tokens, token_count);
-    } else if (strcmp(tokens[0], "bg") == 0) {
-        bg_command(tokens, token_count);
-    } else if (strcmp(tokens[0], "reveal") == 0) {
-        reveal(&tokens[1], token_count - 1, prev_dir, SHELL_HOME_DIR);
-    } else if (strcmp(tokens[0], "log") == 0) {
-        handle_log_command(&tokens[1], token_count - 1, prev_dir, SHELL_HOME_DIR);
-    } else if (strcmp(tokens[0], "activities") == 0) {
-        list_activities();
-    } else if (strcmp(tokens[0], "ping") == 0) {
-        if (token_count != 3) fprintf(stderr, "Syntax: ping <pid> <signal_number>\n");
-        else ping((pid_t)strtol(tokens[1], NULL, 10), (int)strtol(tokens[2], NULL, 10));
+    list_activities();
+    return 0;
+}
+
+static int run_ping(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    if (token_count != 3) {
+        fprintf(stderr, "Syntax: ping <pid> <signal_number>\n");
+        return 1;
     }
+    ping((pid_t)strtol(tokens[1], NULL, 10), (int)strtol(tokens[2], NULL, 10));
+    return 0;
+}
+
+static int run_batch(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return batch_command(tokens, token_count);
+}
+
+static int run_jobout(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return jobout_command(tokens, token_count);
+}
+
+static int run_echo(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return echo_command(tokens, token_count);
+}
+
+static int run_true(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)tokens; (void)token_count; (void)prev_dir; (void)SHELL_HOME_DIR;
+    return 0;
+}
+
+static int run_false(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)tokens; (void)token_count; (void)prev_dir; (void)SHELL_HOME_DIR;
+    return 1;
+}
+
+static int run_test(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return test_command(tokens, token_count);
+}
+
+static int run_cat(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return cat_command(tokens, token_count);
+}
+
+static int run_repin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return repin_command(tokens, token_count);
+}
+
+static int run_renice(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return renice_command(tokens, token_count);
+}
+
+static int run_reionice(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    (void)prev_dir; (void)SHELL_HOME_DIR;
+    return reionice_command(tokens, token_count);
+}
+
+static int run_onchange(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    return onchange_command(tokens, token_count, prev_dir, SHELL_HOME_DIR);
+}
+
+// A perfect hash of a name's length and first and last characters. Slots
+// are computed at compile time, and two builtins landing in the same one
+// show up as an -Woverride-init warning.
+#define BUILTIN_TABLE_SIZE 64
+#define BUILTIN_SLOT(length, first, last) \
+    (((unsigned)(first) + 5u * (unsigned)(last) + 7u * (unsigned)(length)) % BUILTIN_TABLE_SIZE)
+
+static const Builtin builtins[BUILTIN_TABLE_SIZE] = {
+    [BUILTIN_SLOT(3, 'h', 'p')]  = { "hop", SPECIAL_BUILTIN, run_hop },
+    [BUILTIN_SLOT(4, 'e', 't')]  = { "exit", SPECIAL_BUILTIN, run_exit },
+    [BUILTIN_SLOT(4, 'd', 's')]  = { "dirs", REGULAR_BUILTIN, run_dirs },
+    [BUILTIN_SLOT(2, 'f', 'g')]  = { "fg", SPECIAL_BUILTIN, run_fg },
+    [BUILTIN_SLOT(2, 'b', 'g')]  = { "bg", SPECIAL_BUILTIN, run_bg },
+    [BUILTIN_SLOT(3, 'l', 'g')]  = { "log", SPECIAL_BUILTIN, run_log },
+    [BUILTIN_SLOT(4, 'e', 'c')]  = { "exec", SPECIAL_BUILTIN, run_exec },
+    [BUILTIN_SLOT(6, 'r', 'l')]  = { "reveal", REGULAR_BUILTIN, run_reveal },
+    [BUILTIN_SLOT(10, 'a', 's')] = { "activities", REGULAR_BUILTIN, run_activities },
+    [BUILTIN_SLOT(4, 'p', 'g')]  = { "ping", REGULAR_BUILTIN, run_ping },
+    [BUILTIN_SLOT(5, 'b', 'h')]  = { "batch", REGULAR_BUILTIN, run_batch },
+    [BUILTIN_SLOT(6, 'j', 't')]  = { "jobout", REGULAR_BUILTIN, run_jobout },
+    [BUILTIN_SLOT(4, 'e', 'o')]  = { "echo", REGULAR_BUILTIN, run_echo },
+    [BUILTIN_SLOT(4, 't', 'e')]  = { "true", REGULAR_BUILTIN, run_true },
+    [BUILTIN_SLOT(5, 'f', 'e')]  = { "false", REGULAR_BUILTIN, run_false },
+    [BUILTIN_SLOT(4, 't', 't')]  = { "test", REGULAR_BUILTIN, run_test },
+    [BUILTIN_SLOT(1, '[', '[')]  = { "[", REGULAR_BUILTIN, run_test },
+    [BUILTIN_SLOT(3, 'c', 't')]  = { "cat", REGULAR_BUILTIN, run_cat },
+    [BUILTIN_SLOT(5, 'r', 'n')]  = { "repin", REGULAR_BUILTIN, run_repin },
+    [BUILTIN_SLOT(6, 'r', 'e')]  = { "renice", REGULAR_BUILTIN, run_renice },
+    [BUILTIN_SLOT(8, 'r', 'e')]  = { "reionice", REGULAR_BUILTIN, run_reionice },
+    [BUILTIN_SLOT(8, 'o', 'e')]  = { "onchange", JOB_BUILTIN, run_onchange },
+};
+
+static const Builtin* find_builtin(const char* cmd) {
+    size_t length = strlen(cmd);
+    if (length == 0) return NULL;
+    const Builtin* builtin = &builtins[BUILTIN_SLOT(length, (unsigned char)cmd[0], (unsigned char)cmd[length - 1])];
+    return builtin->name != NULL && strcmp(builtin->name, cmd) == 0 ? builtin : NULL;
+}
+
+enum BuiltinType get_builtin_type(const char* cmd) {
+    if (!cmd) return NOT_BUILTIN;
+    const Builtin* builtin = find_builtin(cmd);
+    return builtin ? builtin->type : NOT_BUILTIN;
+}
+
+enum BuiltinType get_command_builtin_type(char** tokens, int token_count) {
+    if (token_count <= 0) return NOT_BUILTIN;
+    // The builtin cat has no options; `cat -n` and the like run /bin/cat.
+    if (strcmp(tokens[0], "cat") == 0 && !cat_handles(tokens, token_count)) return NOT_BUILTIN;
+    return get_builtin_type(tokens[0]);
+}
+
+// Runs a builtin and returns its exit status.
+int execute_builtin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    const Builtin* builtin = find_builtin(tokens[0]);
+    return builtin ? builtin->run(tokens, token_count, prev_dir, SHELL_HOME_DIR) : 0;
 }
 
 bool execute(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
@@ -55,22 +219,26 @@ bool execute(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_D
 
     if (is_interactive_mode) {
         check_background_jobs();
+    } else {
+        timeout_enforce_jobs();
     }
 
     int cmd_start = 0;
     for (int i = 0; i < token_count; i++) {
-        if (strcmp(tokens[i], ";") == 0 || strcmp(tokens[i], "&") == 0) {
-            bool background = (strcmp(tokens[i], "&") == 0);
+        if (strcmp(tokens[i], ";") == 0 || strcmp(tokens[i], "&") == 0 || strcmp(tokens[i], "&!") == 0) {
+            // `&!` is `&` with the job's output kept for jobout.
+            bool capture = (strcmp(tokens[i], "&!") == 0);
+            bool background = capture || (strcmp(tokens[i], "&") == 0);
             tokens[i] = NULL;
             const char* command_name = (cmd_start < i && tokens[cmd_start]) ? tokens[cmd_start] : "";
-            execute_pipeline(&tokens[cmd_start], i - cmd_start, background, command_name, prev_dir, SHELL_HOME_DIR);
+            execute_pipeline(&tokens[cmd_start], i - cmd_start, background, capture, command_name, prev_dir, SHELL_HOME_DIR);
             cmd_start = i + 1;
         }
     }
 
     if (cmd_start < token_count) {
         const char* command_name = (tokens[cmd_start]) ? tokens[cmd_start] : "";
-        execute_pipeline(&tokens[cmd_start], token_count - cmd_start, false, command_name, prev_dir, SHELL_HOME_DIR);
+        execute_pipeline(&tokens[cmd_start], token_count - cmd_start, false, false, command_name, prev_dir, SHELL_HOME_DIR);
     }
 
     return true;
@@ -0,0 +1,483 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../include/expand.h"
+#include "../include/reveal.h"
+#include "../include/parser.h"
+#include "../include/parallel.h"
+
+extern int last_exit_status;
+
+// A directory read once per command line and shared by every word that
+// globs it.
+typedef struct {
+    char* path;
+    char** names;
+    unsigned char* types;
+    int count;
+} DirListing;
+
+typedef struct {
+    DirListing** listings;
+    int count;
+    int capacity;
+} DirCache;
+
+typedef struct {
+    char** items;
+    int count;
+    int capacity;
+} MatchList;
+
+static bool has_glob_chars(const char* word) {
+    return strpbrk(word, "*?[") != NULL;
+}
+
+// Matches one bracket expression starting after '['. Returns the pattern
+// position just past the closing ']', or NULL if the class is unterminated.
+static const char* match_class(const char* p, unsigned char c, bool* matched) {
+    bool negate = (*p == '!' || *p == '^');
+    if (negate) p++;
+    bool found = false;
+    bool first = true;
+    while (*p != '\0' && (*p != ']' || first)) {
+        unsigned char lo = (unsigned char)*p++;
+        unsigned char hi = lo;
+        if (*p == '-' && p[1] != '\0' && p[1] != ']') {
+            hi = (unsigned char)p[1];
+            p += 2;
+        }
+        if (c >= lo && c <= hi) found = true;
+        first = false;
+    }
+    if (*p != ']') return NULL;
+    *matched = (found != negate);
+    return p + 1;
+}
+
+// Matches name against a single path component pattern. Only the position
+// after the most recent '*' is remembered, so a mismatch resumes from there
+// instead of backtracking through earlier stars; the cost is bounded by
+// O(pattern * name) for any input.
+bool glob_match(const char* pattern, const char* name) {
+    if (name[0] == '.' && pattern[0] != '.') {
+        return false;
+    }
+
+    const char* p = pattern;
+    const char* n = name;
+    const char* star_p = NULL;
+    const char* star_n = NULL;
+
+    while (*n != '\0') {
+        if (*p == '*') {
+            while (*p == '*') p++;
+            if (*p == '\0') return true;
+            star_p = p;
+            star_n = n;
+            continue;
+        }
+
+        bool matched = false;
+        const char* next = p + 1;
+        if (*p == '?') {
+            matched = true;
+        } else if (*p == '[') {
+            next = match_class(p + 1, (unsigned char)*n, &matched);
+            if (next == NULL) {
+                // An unterminated '[' is an ordinary character.
+                matched = (*n == '[');
+                next = p + 1;
+            }
+        } else if (*p == '\\' && p[1] != '\0') {
+            matched = (p[1] == *n);
+            next = p + 2;
+        } else if (*p != '\0') {
+            matched = (*p == *n);
+        }
+
+        if (matched) {
+            p = next;
+            n++;
+        } else if (star_p != NULL) {
+            p = star_p;
+            n = ++star_n;
+        } else {
+            return false;
+        }
+    }
+
+    while (*p == '*') p++;
+    return *p == '\0';
+}
+
+static bool match_list_add(MatchList* list, const char* path) {
+    if (list->count == list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 16;
+        char** new_items = realloc(list->items, new_capacity * sizeof(char*));
+        if (!new_items) {
+            perror("glob: realloc");
+            return false;
+        }
+        list->items = new_items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count] = strdup(path);
+    if (!list->items[list->count]) return false;
+    list->count++;
+    return true;
+}
+
+static bool read_listing(const char* path, DirListing* listing) {
+    DIR* dir = opendir(path[0] != '\0' ? path : ".");
+    if (dir == NULL) return false;
+
+    int capacity = 16;
+    listing->path = strdup(path);
+    listing->names = malloc(capacity * sizeof(char*));
+    listing->types = malloc(capacity);
+    listing->count = 0;
+    if (!listing->path || !listing->names || !listing->types) {
+        closedir(dir);
+        return false;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (listing->count == capacity) {
+            capacity *= 2;
+            char** new_names = realloc(listing->names, capacity * sizeof(char*));
+            unsigned char* new_types = realloc(listing->types, capacity);
+            if (new_names) listing->names = new_names;
+            if (new_types) listing->types = new_types;
+            if (!new_names || !new_types) break;
+        }
+        listing->names[listing->count] = strdup(entry->d_name);
+        listing->types[listing->count] = entry->d_type;
+        listing->count++;
+    }
+    closedir(dir);
+    return true;
+}
+
+static void free_listing(DirListing* listing) {
+    for (int i = 0; i < listing->count; i++) {
+        free(listing->names[i]);
+    }
+    free(listing->names);
+    free(listing->types);
+    free(listing->path);
+}
+
+// Listings are allocated individually so pointers handed out stay valid
+// while the cache grows underneath a recursive match.
+static const DirListing* cached_listing(DirCache* cache, const char* path) {
+    for (int i = 0; i < cache->count; i++) {
+        if (strcmp(cache->listings[i]->path, path) == 0) {
+            return cache->listings[i];
+        }
+    }
+    if (cache->count == cache->capacity) {
+        int new_capacity = cache->capacity ? cache->capacity * 2 : 4;
+        DirListing** new_listings = realloc(cache->listings, new_capacity * sizeof(DirListing*));
+        if (!new_listings) return NULL;
+        cache->listings = new_listings;
+        cache->capacity = new_capacity;
+    }
+    DirListing* listing = calloc(1, sizeof(DirListing));
+    if (!listing) return NULL;
+    if (!read_listing(path, listing)) {
+        free_listing(listing);
+        free(listing);
+        return NULL;
+    }
+    cache->listings[cache->count++] = listing;
+    return listing;
+}
+
+static bool entry_is_dir(const char* prefix, const char* name, unsigned char type, bool follow_links) {
+    if (type == DT_DIR) return true;
+    if (type != DT_UNKNOWN && !(type == DT_LNK && follow_links)) return false;
+
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", prefix, name);
+    if ((follow_links ? stat(path, &st) : lstat(path, &st)) != 0) return false;
+    return S_ISDIR(st.st_mode);
+}
+
+static void glob_components(const char* prefix, char** comps, int ncomp, DirCache* cache, MatchList* out);
+
+// Matches comps[0] against one directory's entries and continues with the
+// remaining components below every directory that matched.
+static void glob_listing(const char* prefix, const DirListing* listing, char** comps, int ncomp, DirCache* cache, MatchList* out) {
+    char path[PATH_MAX];
+    for (int i = 0; i < listing->count; i++) {
+        if (!glob_match(comps[0], listing->names[i])) continue;
+        if (ncomp == 1) {
+            snprintf(path, sizeof(path), "%s%s", prefix, listing->names[i]);
+            match_list_add(out, path);
+        } else if (entry_is_dir(prefix, listing->names[i], listing->types[i], true)) {
+            snprintf(path, sizeof(path), "%s%s/", prefix, listing->names[i]);
+            glob_components(path, comps + 1, ncomp - 1, cache, out);
+        }
+    }
+}
+
+// '**' walks the tree below prefix. Each directory is read exactly once,
+// its listing is used both to match the next component and to descend, and
+// it is released before moving on. Matching below it passes no DirCache, so
+// listings read for later components (the src/ of **/src/*.c) are released
+// too and memory stays proportional to the depth of the tree rather than
+// its size. Symlinks are not followed.
+static void glob_recursive(const char* prefix, char** comps, int ncomp, MatchList* out) {
+    DirListing listing;
+    memset(&listing, 0, sizeof(listing));
+    if (!read_listing(prefix, &listing)) {
+        free_listing(&listing);
+        return;
+    }
+
+    char path[PATH_MAX];
+    if (ncomp == 0) {
+        // A trailing '**' matches everything below prefix.
+        for (int i = 0; i < listing.count; i++) {
+            if (listing.names[i][0] == '.') continue;
+            snprintf(path, sizeof(path), "%s%s", prefix, listing.names[i]);
+            match_list_add(out, path);
+        }
+    } else if (has_glob_chars(comps[0])) {
+        glob_listing(prefix, &listing, comps, ncomp, NULL, out);
+    } else {
+        glob_components(prefix, comps, ncomp, NULL, out);
+    }
+
+    for (int i = 0; i < listing.count; i++) {
+        if (listing.names[i][0] == '.') continue;
+        if (!entry_is_dir(prefix, listing.names[i], listing.types[i], false)) continue;
+        snprintf(path, sizeof(path), "%s%s/", prefix, listing.names[i]);
+        glob_recursive(path, comps, ncomp, out);
+    }
+    free_listing(&listing);
+}
+
+static void glob_components(const char* prefix, char** comps, int ncomp, DirCache* cache, MatchList* out) {
+    char path[PATH_MAX];
+    if (ncomp == 0) {
+        return;
+    }
+
+    if (strcmp(comps[0], "**") == 0) {
+        while (ncomp > 1 && strcmp(comps[1], "**") == 0) {
+            comps++;
+            ncomp--;
+        }
+        glob_recursive(prefix, comps + 1, ncomp - 1, out);
+        return;
+    }
+
+    if (!has_glob_chars(comps[0])) {
+        struct stat st;
+        if (ncomp == 1) {
+            snprintf(path, sizeof(path), "%s%s", prefix, comps[0]);
+            if (lstat(path, &st) == 0) match_list_add(out, path);
+        } else {
+            snprintf(path, sizeof(path), "%s%s/", prefix, comps[0]);
+            glob_components(path, comps + 1, ncomp - 1, cache, out);
+        }
+        return;
+    }
+
+    // Without a cache (below a '**') the listing lives only for this call.
+    if (cache == NULL) {
+        DirListing listing;
+        memset(&listing, 0, sizeof(listing));
+        if (read_listing(prefix, &listing)) glob_listing(prefix, &listing, comps, ncomp, NULL, out);
+        free_listing(&listing);
+        return;
+    }
+    const DirListing* listing = cached_listing(cache, prefix);
+    if (listing != NULL) {
+        glob_listing(prefix, listing, comps, ncomp, cache, out);
+    }
+}
+
+// Expands one word into out. Returns false if nothing matched.
+static bool glob_word(const char* word, DirCache* cache, MatchList* out) {
+    char* pattern = strdup(word);
+    if (!pattern) return false;
+
+    char* comps[PATH_MAX / 2];
+    int ncomp = 0;
+    char* saveptr;
+    for (char* comp = strtok_r(pattern, "/", &saveptr); comp != NULL && ncomp < (int)(sizeof(comps) / sizeof(comps[0]));
+         comp = strtok_r(NULL, "/", &saveptr)) {
+        comps[ncomp++] = comp;
+    }
+
+    int first_match = out->count;
+    glob_components(word[0] == '/' ? "/" : "", comps, ncomp, cache, out);
+    free(pattern);
+
+    // A trailing slash keeps only directories, and keeps the slash.
+    size_t word_length = strlen(word);
+    if (word_length > 1 && word[word_length - 1] == '/') {
+        int kept = first_match;
+        for (int i = first_match; i < out->count; i++) {
+            struct stat st;
+            char* with_slash = NULL;
+            if (stat(out->items[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+                with_slash = malloc(strlen(out->items[i]) + 2);
+            }
+            if (with_slash) {
+                sprintf(with_slash, "%s/", out->items[i]);
+                out->items[kept++] = with_slash;
+            }
+            free(out->items[i]);
+        }
+        out->count = kept;
+    }
+
+    sort_names(out->items + first_match, out->count - first_match);
+    return out->count > first_match;
+}
+
+static bool is_name_char(char c, bool first) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (!first && c >= '0' && c <= '9');
+}
+
+// Substitutes $NAME, ${NAME} and $? in word. Returns a new string, or NULL
+// if the word has nothing to substitute.
+static char* expand_variables(const char* word) {
+    if (strchr(word, '$') == NULL) return NULL;
+
+    size_t capacity = strlen(word) + 64;
+    size_t length = 0;
+    char* result = malloc(capacity);
+    if (!result) return NULL;
+
+    for (const char* p = word; *p != '\0'; ) {
+        const char* value = NULL;
+        char status[16];
+        char name[256];
+        size_t name_length = 0;
+
+        if (p[0] == '$' && p[1] == '?') {
+            snprintf(status, sizeof(status), "%d", last_exit_status);
+            value = status;
+            p += 2;
+        } else if (p[0] == '$' && p[1] == '{' && strchr(p, '}') != NULL) {
+            const char* end = strchr(p, '}');
+            name_length = (size_t)(end - p - 2);
+            if (name_length >= sizeof(name)) name_length = sizeof(name) - 1;
+            memcpy(name, p + 2, name_length);
+            name[name_length] = '\0';
+            value = getenv(name);
+            if (!value) value = "";
+            p = end + 1;
+        } else if (p[0] == '$' && is_name_char(p[1], true)) {
+            p++;
+            while (is_name_char(*p, name_length == 0) && name_length < sizeof(name) - 1) {
+                name[name_length++] = *p++;
+            }
+            name[name_length] = '\0';
+            value = getenv(name);
+            if (!value) value = "";
+        }
+
+        size_t piece_length = value ? strlen(value) : 1;
+        if (length + piece_length + 1 > capacity) {
+            capacity = (length + piece_length + 1) * 2;
+            char* new_result = realloc(result, capacity);
+            if (!new_result) {
+                free(result);
+                return NULL;
+            }
+            result = new_result;
+        }
+        if (value) {
+            memcpy(result + length, value, piece_length);
+        } else {
+            result[length] = *p++;
+        }
+        length += piece_length;
+    }
+    result[length] = '\0';
+    return result;
+}
+
+int expand_tokens(char** tokens, int token_count, ArgVector* args, const char* home_dir) {
+    DirCache cache = { NULL, 0, 0 };
+
+    for (int i = 0; i < token_count; i++) {
+        char* word = tokens[i];
+        bool word_allocated = false;
+        // Expanded later, by the shell that runs the substituted command.
+        if (is_process_substitution(word)) {
+            arg_vector_push(args, word, false);
+            continue;
+        }
+        // `[N]` and `[N:o]` in command position are parallel prefixes for
+        // the pipeline, not bracket expressions.
+        int workers;
+        bool ordered;
+        if ((i == 0 || strcmp(tokens[i - 1], "|") == 0) && parse_parallel_prefix(word, &workers, &ordered)) {
+            arg_vector_push(args, word, false);
+            continue;
+        }
+        char* substituted = expand_variables(word);
+        if (substituted) {
+            word = substituted;
+            word_allocated = true;
+        }
+        // A word with a quoted part is taken as it is, apart from a '~'
+        // before the quotes.
+        char* mark = strchr(word, QUOTED_WORD);
+        bool quoted = mark != NULL;
+        bool quoted_tilde = mark == word;
+        if (quoted) {
+            if (!word_allocated) {
+                word = strdup(word);
+                if (!word) continue;
+                mark = strchr(word, QUOTED_WORD);
+                word_allocated = true;
+            }
+            memmove(mark, mark + 1, strlen(mark));
+        }
+        if (word[0] == '~' && !quoted_tilde) {
+            char buffer[4096];
+            snprintf(buffer, sizeof(buffer), "%s%s", home_dir, word + 1);
+            if (word_allocated) free(word);
+            word = strdup(buffer);
+            word_allocated = true;
+        }
+
+        MatchList matches = { NULL, 0, 0 };
+        if (!quoted && has_glob_chars(word) && glob_word(word, &cache, &matches)) {
+            for (int m = 0; m < matches.count; m++) {
+                if (!arg_vector_push(args, matches.items[m], true)) free(matches.items[m]);
+            }
+            free(matches.items);
+            if (word_allocated) free(word);
+            continue;
+        }
+        free(matches.items);
+
+        if (!arg_vector_push(args, word, word_allocated) && word_allocated) free(word);
+    }
+
+    for (int i = 0; i < cache.count; i++) {
+        free_listing(cache.listings[i]);
+        free(cache.listings[i]);
+    }
+    free(cache.listings);
+    return args->count;
+}
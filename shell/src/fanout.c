@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "../include/fanout.h"
+#include "../include/signals.h"
+#include "../include/placement.h"
+
+
+#define CHUNK_SIZE (1 << 20)
+#define SOURCE_FD 3
+#define PASS_FD 4
+
+// Copies up to max bytes with read()/write(), for the targets splice()
+// cannot write to, such as terminals. Returns the bytes copied, 0 at EOF.
+static ssize_t copy_once(int from, int to, size_t max) {
+    static char buffer[65536];
+    ssize_t n;
+    do {
+        n = read(from, buffer, max < sizeof(buffer) ? max : sizeof(buffer));
+    } while (n == -1 && errno == EINTR);
+    for (ssize_t done = 0; done < n; ) {
+        ssize_t w = write(to, buffer + done, (size_t)(n - done));
+        if (w == -1 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        done += w;
+    }
+    return n;
+}
+
+// Moves exactly length bytes from the pipe from to to.
+static bool move_bytes(int from, int to, size_t length, bool* use_splice) {
+    while (length > 0) {
+        ssize_t n = -1;
+        if (*use_splice) {
+            n = splice(from, NULL, to, NULL, length, SPLICE_F_MOVE);
+            if (n == -1 && errno == EINTR) continue;
+            if (n == -1 && errno == EINVAL) *use_splice = false;
+        }
+        if (!*use_splice) n = copy_once(from, to, length);
+        if (n <= 0) return false;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Places a and b on SOURCE_FD and PASS_FD and closes everything else, so a
+// helper holds no pipe ends that would keep another stage from seeing EOF.
+static void keep_fds(int a, int b) {
+    int high_a = fcntl(a, F_DUPFD, 10);
+    int high_b = fcntl(b, F_DUPFD, 10);
+    dup2(high_a, SOURCE_FD);
+    dup2(high_b, PASS_FD);
+    close_range(PASS_FD + 1, ~0U, 0);
+}
+
+// Copies SOURCE_FD into path and passes the same bytes on to PASS_FD.
+static void run_tee_helper(const char* path) {
+    int file_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    bool file_ok = (file_fd != -1);
+    if (!file_ok) {
+        // Keep the data flowing to the other targets regardless.
+        fprintf(stderr, "Unable to create file for writing\n");
+        file_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    }
+    bool use_splice = true;
+    for (;;) {
+        ssize_t n = tee(SOURCE_FD, PASS_FD, CHUNK_SIZE, 0);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) {
+            perror("tee");
+            _exit(1);
+        }
+        if (n == 0) break;
+        // The copy for the next target is made; consume ours into the file.
+        if (!move_bytes(SOURCE_FD, file_fd, (size_t)n, &use_splice)) _exit(1);
+    }
+    _exit(file_ok ? 0 : 1);
+}
+
+// Moves SOURCE_FD into PASS_FD until EOF, for an output that is not a pipe.
+static void run_drain_helper(void) {
+    bool use_splice = true;
+    for (;;) {
+        ssize_t n = -1;
+        if (use_splice) {
+            n = splice(SOURCE_FD, NULL, PASS_FD, NULL, CHUNK_SIZE, SPLICE_F_MOVE);
+            if (n == -1 && errno == EINTR) continue;
+            if (n == -1 && errno == EINVAL) use_splice = false;
+        }
+        if (!use_splice) n = copy_once(SOURCE_FD, PASS_FD, CHUNK_SIZE);
+        if (n == 0) _exit(0);
+        if (n < 0) _exit(1);
+    }
+}
+
+static pid_t fork_helper(int source, int pass, const char* path, pid_t* pgid) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        reset_child_signals();
+        setpgid(0, *pgid);
+        placement_apply_in_child();
+        keep_fds(source, pass);
+        if (path != NULL) run_tee_helper(path);
+        run_drain_helper();
+    }
+    if (*pgid == 0) *pgid = pid;
+    setpgid(pid, *pgid);
+    return pid;
+}
+
+static bool is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+bool start_fanout(int in_fd, char** paths, int path_count, int out_fd, pid_t* pgid, pid_t* pids, int* pid_count) {
+    // Helper i tees its source into a fresh pipe, which becomes helper i+1's
+    // source. The last one tees straight into out_fd when that is a pipe;
+    // otherwise a final helper splices into it.
+    int source = in_fd;
+    bool ok = true;
+    for (int i = 0; i < path_count && ok; i++) {
+        bool last = (i == path_count - 1);
+        int pass[2] = { -1, -1 };
+        if (last && is_pipe(out_fd)) {
+            pass[1] = out_fd;
+        } else if (pipe2(pass, O_CLOEXEC) == -1) {
+            perror("pipe");
+            ok = false;
+            break;
+        }
+
+        pid_t pid = fork_helper(source, pass[1], paths[i], pgid);
+        if (pid == -1) ok = false;
+        else pids[(*pid_count)++] = pid;
+
+        if (source != in_fd) close(source);
+        if (pass[1] != out_fd) close(pass[1]);
+        source = pass[0];
+    }
+
+    if (ok && source != -1) {
+        pid_t pid = fork_helper(source, out_fd, NULL, pgid);
+        if (pid == -1) ok = false;
+        else pids[(*pid_count)++] = pid;
+    }
+    if (source != -1 && source != in_fd) close(source);
+    return ok;
+}
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #include <signal.h>
 #include "../include/fg_bg.h"
 #include "../include/jobs.h"
+#include "../include/timeout.h"
 
 // External global variables
 extern pid_t foreground_pid;
@@ -42,8 +44,10 @@ void fg_command(char** tokens, int token_count) {
         }
     }
 
+    // A job started with &! shows its output while in the foreground.
     int status;
-    pid_t wait_result = waitpid(-pgid, &status, WUNTRACED);
+    pid_t wait_result = timeout_waitpid_serving(-pgid, &status, pgid, &job->timeout,
+                                                job_output_fd(job->output), show_job_output, job->output);
     
     if (wait_result != -1) {
         if (WIFSTOPPED(status)) {
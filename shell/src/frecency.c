@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <ctype.h>
+#include <pwd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "../include/frecency.h"
+
+#define DIRS_FILE_NAME ".shell_dirs"
+// Past this size, and once most of its lines repeat a directory, the file is
+// rewritten with one line per directory.
+#define DIRS_COMPACT_SIZE (64 * 1024)
+// When rewritten, ranks are scaled down to this total, and directories
+// whose rank falls below 1 are forgotten.
+#define MAX_TOTAL_RANK 9000.0
+
+// One line per visit, "<unix time>\t<rank>\t<directory>", appended under a
+// shared flock(). A rewrite takes the lock exclusively and replaces the
+// file, which other sessions notice by its inode, as with the history.
+typedef struct {
+    char* path;
+    char* folded;         // path in lower case, in the same allocation
+    double rank;
+    long long last_visit;
+} DirEntry;
+
+static DirEntry* entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+// Open-addressed hash of path to entry index, -1 for a free slot.
+static int* slots = NULL;
+static int slot_count = 0;
+
+static int dirs_fd = -1;
+static off_t dirs_offset = 0;
+static int line_count = 0;
+
+static uint64_t hash_string(const char* text) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void get_dirs_file_path(char* path, size_t size) {
+    const char* home_dir = getenv("HOME");
+    if (!home_dir) {
+        struct passwd* pw = getpwuid(getuid());
+        home_dir = pw ? pw->pw_dir : "/";
+    }
+    snprintf(path, size, "%s/%s", home_dir, DIRS_FILE_NAME);
+}
+
+static void forget_entries(void) {
+    for (int i = 0; i < entry_count; i++) {
+        free(entries[i].path);
+    }
+    entry_count = 0;
+    line_count = 0;
+    for (int i = 0; i < slot_count; i++) {
+        slots[i] = -1;
+    }
+}
+
+// The slot holding path, or the free slot where it belongs.
+static int find_slot(const char* path) {
+    int mask = slot_count - 1;
+    int slot = (int)(hash_string(path) & (uint64_t)mask);
+    while (slots[slot] != -1 && strcmp(entries[slots[slot]].path, path) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Keeps the table at most half full.
+static bool grow_slots(void) {
+    if (slot_count >= 2 * (entry_count + 1)) return true;
+    int new_count = slot_count ? slot_count * 2 : 256;
+    int* new_slots = malloc((size_t)new_count * sizeof(int));
+    if (!new_slots) return false;
+    free(slots);
+    slots = new_slots;
+    slot_count = new_count;
+    for (int i = 0; i < slot_count; i++) slots[i] = -1;
+    for (int i = 0; i < entry_count; i++) {
+        slots[find_slot(entries[i].path)] = i;
+    }
+    return true;
+}
+
+static void add_visits(const char* path, double rank, long long when) {
+    if (slot_count == 0 && !grow_slots()) return;
+    int slot = find_slot(path);
+    if (slots[slot] != -1) {
+        DirEntry* entry = &entries[slots[slot]];
+        entry->rank += rank;
+        if (when > entry->last_visit) entry->last_visit = when;
+        return;
+    }
+    if (entry_count == entry_capacity) {
+        int new_capacity = entry_capacity ? entry_capacity * 2 : 128;
+        DirEntry* grown = realloc(entries, (size_t)new_capacity * sizeof(DirEntry));
+        if (!grown) return;
+        entries = grown;
+        entry_capacity = new_capacity;
+    }
+    size_t length = strlen(path);
+    char* copy = malloc(2 * length + 2);
+    if (!copy) return;
+    memcpy(copy, path, length + 1);
+    char* folded = copy + length + 1;
+    for (size_t i = 0; i <= length; i++) folded[i] = (char)tolower((unsigned char)path[i]);
+    entries[entry_count] = (DirEntry){ copy, folded, rank, when };
+    entry_count++;
+    if (!grow_slots()) return;
+    slots[find_slot(path)] = entry_count - 1;
+}
+
+static void parse_line(char* line) {
+    char* rank_start = strchr(line, '\t');
+    char* path = rank_start ? strchr(rank_start + 1, '\t') : NULL;
+    if (!path || path[1] != '/') return;
+    *path++ = '\0';
+    line_count++;
+    add_visits(path, strtod(rank_start + 1, NULL), strtoll(line, NULL, 10));
+}
+
+// Reads the complete lines between dirs_offset and size.
+static void read_new_lines(off_t size) {
+    char buffer[65536];
+    size_t kept = 0;
+    while (dirs_offset + (off_t)kept < size) {
+        ssize_t n = pread(dirs_fd, buffer + kept, sizeof(buffer) - 1 - kept, dirs_offset + (off_t)kept);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        size_t length = kept + (size_t)n;
+        size_t start = 0;
+        for (size_t i = 0; i < length; i++) {
+            if (buffer[i] != '\n') continue;
+            buffer[i] = '\0';
+            parse_line(buffer + start);
+            start = i + 1;
+        }
+        dirs_offset += (off_t)start;
+        // A line longer than the buffer is skipped.
+        if (start == 0 && length == sizeof(buffer) - 1) {
+            dirs_offset += (off_t)length;
+            start = length;
+        }
+        kept = length - start;
+        memmove(buffer, buffer + start, kept);
+    }
+}
+
+static bool file_replaced(int fd, const char* path) {
+    struct stat by_path, by_fd;
+    if (stat(path, &by_path) != 0 || fstat(fd, &by_fd) != 0) return true;
+    return by_path.st_ino != by_fd.st_ino || by_path.st_dev != by_fd.st_dev;
+}
+
+// Brings the index up to date with the file, reading only what was
+// appended since the last call unless the file was replaced.
+static void sync_dirs(void) {
+    char path[PATH_MAX];
+    get_dirs_file_path(path, sizeof(path));
+    if (dirs_fd == -1 || file_replaced(dirs_fd, path)) {
+        if (dirs_fd != -1) close(dirs_fd);
+        dirs_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        dirs_offset = 0;
+        forget_entries();
+        if (dirs_fd == -1) return;
+    }
+    struct stat st;
+    if (fstat(dirs_fd, &st) != 0) return;
+    if (st.st_size < dirs_offset) {
+        // Truncated by hand.
+        dirs_offset = 0;
+        forget_entries();
+    }
+    if (st.st_size > dirs_offset) read_new_lines(st.st_size);
+}
+
+// Locks the current file, following it if it is replaced while waiting.
+static bool lock_dirs(int operation) {
+    char path[PATH_MAX];
+    get_dirs_file_path(path, sizeof(path));
+    for (;;) {
+        sync_dirs();
+        if (dirs_fd == -1) return false;
+        while (flock(dirs_fd, operation) == -1) {
+            if (errno != EINTR) return false;
+        }
+        if (!file_replaced(dirs_fd, path)) {
+            // Picks up what was appended while waiting.
+            sync_dirs();
+            return true;
+        }
+        flock(dirs_fd, LOCK_UN);
+    }
+}
+
+static bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Rewrites the file as one line per directory. Runs under the exclusive
+// lock of the old file, so that waiting writers retry on the new one.
+static void compact_dirs(void) {
+    char path[PATH_MAX], temp_path[PATH_MAX + 32];
+    get_dirs_file_path(path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", path, (int)getpid());
+    int out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out == -1) return;
+
+    double total = 0;
+    for (int i = 0; i < entry_count; i++) total += entries[i].rank;
+    double scale = total > MAX_TOTAL_RANK ? MAX_TOTAL_RANK / total : 1.0;
+    bool ok = true;
+    for (int i = 0; i < entry_count && ok; i++) {
+        double rank = entries[i].rank * scale;
+        if (rank < 1.0) continue;
+        char* line = NULL;
+        int length = asprintf(&line, "%lld\t%.2f\t%s\n", entries[i].last_visit, rank, entries[i].path);
+        ok = length > 0 && write_all(out, line, (size_t)length);
+        free(line);
+    }
+    if (ok && fdatasync(out) == 0 && rename(temp_path, path) == 0) {
+        close(out);
+    } else {
+        close(out);
+        unlink(temp_path);
+    }
+}
+
+static bool needs_compaction(void) {
+    return dirs_offset > DIRS_COMPACT_SIZE && line_count > 2 * entry_count;
+}
+
+void frecency_visit(const char* dir) {
+    if (!lock_dirs(LOCK_SH)) return;
+    char line[PATH_MAX + 64];
+    int length = snprintf(line, sizeof(line), "%lld\t1\t%s\n", (long long)time(NULL), dir);
+    if (length > 0 && (size_t)length < sizeof(line)) write_all(dirs_fd, line, (size_t)length);
+    // Read back through the offset like any other session's visit.
+    sync_dirs();
+    flock(dirs_fd, LOCK_UN);
+    if (needs_compaction() && lock_dirs(LOCK_EX)) {
+        // Another session may have compacted it first.
+        if (needs_compaction()) compact_dirs();
+        flock(dirs_fd, LOCK_UN);
+    }
+}
+
+// Rank weighted by how recently the directory was visited, as in z.
+static double score(const DirEntry* entry, long long now) {
+    long long age = now - entry->last_visit;
+    if (age < 3600) return entry->rank * 4;
+    if (age < 86400) return entry->rank * 2;
+    if (age < 7 * 86400) return entry->rank / 2;
+    return entry->rank / 4;
+}
+
+const char* frecency_best(const char* partial, const char* exclude) {
+    sync_dirs();
+    // Smartcase: capitals in partial make it match case.
+    char folded[PATH_MAX];
+    bool match_case = false;
+    size_t length = 0;
+    for (; partial[length] && length < sizeof(folded) - 1; length++) {
+        if (isupper((unsigned char)partial[length])) match_case = true;
+        folded[length] = (char)tolower((unsigned char)partial[length]);
+    }
+    folded[length] = '\0';
+
+    long long now = (long long)time(NULL);
+    for (;;) {
+        DirEntry* best = NULL;
+        double best_score = 0;
+        for (int i = 0; i < entry_count; i++) {
+            DirEntry* entry = &entries[i];
+            if (entry->rank <= 0) continue;
+            // The score is cheaper than the match, so it goes first.
+            double s = score(entry, now);
+            if (best != NULL && s <= best_score) continue;
+            if (!(match_case ? strstr(entry->path, partial) : strstr(entry->folded, folded))) continue;
+            if (exclude && strcmp(entry->path, exclude) == 0) continue;
+            best = entry;
+            best_score = s;
+        }
+        if (best == NULL) return NULL;
+        struct stat st;
+        if (stat(best->path, &st) == 0 && S_ISDIR(st.st_mode)) return best->path;
+        // Gone: left out from now on, and dropped at the next rewrite.
+        best->rank = 0;
+    }
+}
+
+static long long list_now;
+
+static int compare_scores(const void* a, const void* b) {
+    double x = score(*(DirEntry* const*)a, list_now), y = score(*(DirEntry* const*)b, list_now);
+    return (x < y) - (x > y);
+}
+
+void frecency_list(int max) {
+    sync_dirs();
+    DirEntry** sorted = malloc((size_t)(entry_count ? entry_count : 1) * sizeof(DirEntry*));
+    if (!sorted) return;
+    int count = 0;
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].rank > 0) sorted[count++] = &entries[i];
+    }
+    list_now = (long long)time(NULL);
+    qsort(sorted, (size_t)count, sizeof(DirEntry*), compare_scores);
+    for (int i = 0; i < count && i < max; i++) {
+        printf("%8.1f  %s\n", score(sorted[i], list_now), sorted[i]->path);
+    }
+    free(sorted);
+}
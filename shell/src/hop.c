@@ -6,10 +6,60 @@
 #include <stdlib.h>
 #include <limits.h>
 #include "../include/hop.h"
+#include "../include/frecency.h"
+
+#define DIR_STACK_SIZE 32
+
+// The directory stack, most recent first: entry 0 is the current directory,
+// so the prompt does not need getcwd(). Each entry is a PATH_MAX buffer, and
+// buffers leaving the stack are kept in spare_dir for the next hop.
+static char* dir_stack[DIR_STACK_SIZE];
+static int dir_stack_depth = 0;
+static char* spare_dir = NULL;
+
+static bool load_current_directory(void) {
+    if (dir_stack_depth > 0) return true;
+    char* dir = malloc(PATH_MAX);
+    if (dir == NULL || getcwd(dir, PATH_MAX) == NULL) {
+        free(dir);
+        return false;
+    }
+    dir_stack[0] = dir;
+    dir_stack_depth = 1;
+    return true;
+}
+
+const char* current_directory(void) {
+    return load_current_directory() ? dir_stack[0] : NULL;
+}
+
+void refresh_current_directory(void) {
+    if (dir_stack_depth > 0 && getcwd(dir_stack[0], PATH_MAX) == NULL) {
+        perror("getcwd failed");
+    }
+}
+
+// Puts spare_dir, holding the new current directory, on top of the stack,
+// dropping any older entry for the same directory.
+static void push_directory(void) {
+    int found = 1;
+    while (found < dir_stack_depth && strcmp(dir_stack[found], spare_dir) != 0) found++;
+    char* released = NULL;
+    if (found < dir_stack_depth) {
+        released = dir_stack[found];
+    } else if (dir_stack_depth == DIR_STACK_SIZE) {
+        released = dir_stack[DIR_STACK_SIZE - 1];
+        found = DIR_STACK_SIZE - 1;
+    } else {
+        found = dir_stack_depth++;
+    }
+    memmove(&dir_stack[1], &dir_stack[0], (size_t)found * sizeof(char*));
+    dir_stack[0] = spare_dir;
+    spare_dir = released;
+}
 
 bool change_directory(const char* path, char** prev_dir) {
-    char old_dir[PATH_MAX];
-    if (getcwd(old_dir, sizeof(old_dir)) == NULL) {
+    if (!load_current_directory()) {
         perror("getcwd failed");
         return false;
     }
@@ -19,10 +69,27 @@ bool change_directory(const char* path, char** prev_dir) {
         return false;
     }
 
-    if (*prev_dir != NULL) {
-        free(*prev_dir);
+    if (spare_dir == NULL && (spare_dir = malloc(PATH_MAX)) == NULL) {
+        perror("malloc");
+        return false;
     }
-    *prev_dir = strdup(old_dir);
+    if (getcwd(spare_dir, PATH_MAX) == NULL) {
+        perror("getcwd failed");
+        return false;
+    }
+
+    // prev_dir keeps the PATH_MAX buffer it is given the first time.
+    if (*prev_dir == NULL) {
+        *prev_dir = malloc(PATH_MAX);
+        if (*prev_dir == NULL) {
+            perror("malloc");
+            return false;
+        }
+    }
+    memcpy(*prev_dir, dir_stack[0], strlen(dir_stack[0]) + 1);
+
+    push_directory();
+    frecency_visit(dir_stack[0]);
     return true;
 }
 
@@ -42,6 +109,25 @@ bool hop(char** args, int num_args, char** prev_dir, const char* home_dir) {
             }
             strncpy(target_path, *prev_dir, PATH_MAX - 1);
             target_path[PATH_MAX - 1] = '\0';
+        } else if (args[0][0] == '+' && args[0][1] != '\0') {
+            // Go to an entry of the directory stack
+            char* end;
+            long index = strtol(args[0] + 1, &end, 10);
+            if (*end != '\0' || !load_current_directory() || index < 0 || index >= dir_stack_depth) {
+                fprintf(stderr, "hop: %s: no such entry in the directory stack\n", args[0]);
+                return false;
+            }
+            strncpy(target_path, dir_stack[index], PATH_MAX - 1);
+            target_path[PATH_MAX - 1] = '\0';
+        } else if (args[0][0] == '@' && args[0][1] != '\0') {
+            // Go to the best-scoring visited directory matching the rest
+            const char* best = frecency_best(args[0] + 1, current_directory());
+            if (best == NULL) {
+                fprintf(stderr, "hop: no match for %s\n", args[0] + 1);
+                return false;
+            }
+            strncpy(target_path, best, PATH_MAX - 1);
+            target_path[PATH_MAX - 1] = '\0';
         } else {
             // Go to specified path (which might be an expanded ~)
             strncpy(target_path, args[0], PATH_MAX - 1);
@@ -58,4 +144,34 @@ bool hop(char** args, int num_args, char** prev_dir, const char* home_dir) {
     }
 
     return false;
-}
\ No newline at end of file
+}
+
+static void print_directory(const char* dir, const char* home_dir) {
+    size_t home_length = strlen(home_dir);
+    if (home_length > 1 && strncmp(dir, home_dir, home_length) == 0 &&
+        (dir[home_length] == '/' || dir[home_length] == '\0')) {
+        printf("~%s\n", dir + home_length);
+    } else {
+        printf("%s\n", dir);
+    }
+}
+
+bool dirs(char** args, int num_args, const char* home_dir) {
+    if (num_args == 1 && strcmp(args[0], "-f") == 0) {
+        frecency_list(20);
+        return true;
+    }
+    if (num_args != 0) {
+        fprintf(stderr, "Syntax: dirs [-f]\n");
+        return false;
+    }
+    if (!load_current_directory()) {
+        perror("getcwd failed");
+        return false;
+    }
+    for (int i = 0; i < dir_stack_depth; i++) {
+        printf("%2d  ", i);
+        print_directory(dir_stack[i], home_dir);
+    }
+    return true;
+}
@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include "../include/jobout.h"
+#include "../include/jobs.h"
+#include "../include/eventloop.h"
+#include "../include/signals.h"
+
+// Per job. Pages are only allocated as output arrives, so a quiet job
+// costs next to nothing.
+#define RING_SIZE (1024 * 1024)
+
+struct JobOutput {
+    int pipe_fd;          // -1 once the job has closed its end
+    bool watched;         // pipe_fd is registered with the event loop
+    // Both live in the memfd, so a forked `jobout 1 | less` sees and
+    // updates the same ring as the shell.
+    uint64_t* written;    // bytes captured so far
+    char* ring;           // RING_SIZE bytes, mapped twice back to back
+    size_t header_size;
+    uint64_t shown;       // how far `fg` has echoed
+};
+
+// Maps a memfd holding a one-page header and the ring. The ring is mapped
+// twice in a row, so any RING_SIZE bytes starting inside the first copy are
+// contiguous and neither reads nor writes have to wrap.
+static bool map_ring(JobOutput* output, int job_number) {
+    char name[32];
+    snprintf(name, sizeof(name), "job-%d-output", job_number);
+    int memfd = memfd_create(name, MFD_CLOEXEC);
+    if (memfd == -1) {
+        perror("memfd_create");
+        return false;
+    }
+    output->header_size = (size_t)sysconf(_SC_PAGESIZE);
+    bool ok = ftruncate(memfd, (off_t)(output->header_size + RING_SIZE)) == 0;
+    void* header = ok ? mmap(NULL, output->header_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0) : MAP_FAILED;
+    char* ring = ok ? mmap(NULL, 2 * RING_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+    ok = header != MAP_FAILED && ring != MAP_FAILED;
+    for (int i = 0; ok && i < 2; i++) {
+        void* half = mmap(ring + i * RING_SIZE, RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, (off_t)output->header_size);
+        ok = half != MAP_FAILED;
+    }
+    // The mappings keep the memory alive.
+    close(memfd);
+    if (!ok) {
+        perror("mmap");
+        if (header != MAP_FAILED) munmap(header, output->header_size);
+        if (ring != MAP_FAILED) munmap(ring, 2 * RING_SIZE);
+        return false;
+    }
+    output->written = header;
+    output->ring = ring;
+    return true;
+}
+
+static void stop_watching(JobOutput* output) {
+    if (output->watched) event_loop_remove_fd(output->pipe_fd);
+    output->watched = false;
+    close(output->pipe_fd);
+    output->pipe_fd = -1;
+}
+
+// Moves what is waiting in the pipe into the ring, up to a ring's worth so
+// a chatty job cannot hold the caller up. Returns false at EOF.
+static bool drain(JobOutput* output) {
+    size_t moved = 0;
+    while (output->pipe_fd != -1 && moved < RING_SIZE) {
+        ssize_t n = read(output->pipe_fd, output->ring + *output->written % RING_SIZE, RING_SIZE - moved);
+        if (n > 0) {
+            *output->written += (uint64_t)n;
+            moved += (size_t)n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && errno == EAGAIN) {
+            return true;
+        } else {
+            stop_watching(output);
+        }
+    }
+    return output->pipe_fd != -1;
+}
+
+static void on_output(int fd, void* data) {
+    (void)fd;
+    drain(data);
+}
+
+// Writes out the bytes captured from position from on, noting any that the
+// ring has already overwritten. Returns the position reached.
+static uint64_t print_since(const JobOutput* output, uint64_t from) {
+    uint64_t written = *output->written;
+    if (written - from > RING_SIZE) {
+        fflush(stdout);
+        fprintf(stderr, "[%llu bytes of earlier output dropped]\n", (unsigned long long)(written - RING_SIZE - from));
+        from = written - RING_SIZE;
+    }
+    fwrite(output->ring + from % RING_SIZE, 1, (size_t)(written - from), stdout);
+    fflush(stdout);
+    return written;
+}
+
+void capture_job_output(pid_t pgid, int read_fd) {
+    BackgroundJob* job = NULL;
+    for (int i = 0; i < background_job_count; i++) {
+        if (background_jobs[i].pid == pgid) job = &background_jobs[i];
+    }
+    JobOutput* output = job ? calloc(1, sizeof(JobOutput)) : NULL;
+    if (!output || !map_ring(output, job->job_number)) {
+        // The job blocks once the pipe fills, rather than writing nowhere.
+        free(output);
+        close(read_fd);
+        return;
+    }
+    fcntl(read_fd, F_SETFL, O_NONBLOCK);
+    output->pipe_fd = read_fd;
+    // Without an event loop (in a script) the pipe is drained by jobout.
+    output->watched = event_loop_add_fd(read_fd, on_output, output);
+    job->output = output;
+}
+
+void release_job_output(JobOutput* output) {
+    if (output == NULL) return;
+    if (output->pipe_fd != -1) stop_watching(output);
+    munmap(output->written, output->header_size);
+    munmap(output->ring, 2 * RING_SIZE);
+    free(output);
+}
+
+int job_output_fd(const JobOutput* output) {
+    return output ? output->pipe_fd : -1;
+}
+
+bool show_job_output(void* data) {
+    JobOutput* output = data;
+    bool open = drain(output);
+    output->shown = print_since(output, output->shown);
+    return open;
+}
+
+int jobout_command(char** tokens, int token_count) {
+    bool follow = false;
+    const char* number = NULL;
+    for (int i = 1; i < token_count; i++) {
+        if (strcmp(tokens[i], "-f") == 0) follow = true;
+        else if (number == NULL) number = tokens[i];
+        else number = "";
+    }
+    if (number != NULL && *number == '\0') {
+        fprintf(stderr, "Syntax: jobout [job_number] [-f]\n");
+        return 1;
+    }
+    BackgroundJob* job = number ? find_job_by_number(atoi(number)) : find_most_recent_job();
+    if (job == NULL) {
+        fprintf(stderr, "No such job\n");
+        return 1;
+    }
+    JobOutput* output = job->output;
+    if (output == NULL) {
+        fprintf(stderr, "jobout: [%d] was not started with &!\n", job->job_number);
+        return 1;
+    }
+
+    bool open = drain(output);
+    uint64_t shown = print_since(output, 0);
+    // Follow until the job closes its output or Ctrl-C.
+    while (follow && open) {
+        struct pollfd fds = { output->pipe_fd, POLLIN, 0 };
+        if (poll(&fds, 1, 100) == -1 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+        if (interrupt_requested()) return 130;
+        open = drain(output);
+        shown = print_since(output, shown);
+    }
+    return 0;
+}
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,15 +9,27 @@
 #include <errno.h>
 #include <signal.h>
 #include "../include/jobs.h"
+#include "../include/zygote.h"
 
 // Global job management variables
-BackgroundJob background_jobs[256];
+BackgroundJob background_jobs[MAX_JOBS];
 int background_job_count = 0;
 static int next_job_number = 1;
 
 // External global variables (declared in main.c or elsewhere)
 extern bool is_interactive_mode;
 
+// Set while reporting from the event loop: the prompt is already on screen
+// and has to be cleared before the first message is printed over it.
+static bool erase_prompt_first = false;
+
+static void begin_notification(void) {
+    if (erase_prompt_first) {
+        fprintf(stderr, "\r\033[K");
+        erase_prompt_first = false;
+    }
+}
+
 const char* get_job_state_string(JobState state) {
     switch (state) {
         case RUNNING:
@@ -36,6 +49,8 @@ void add_background_job(pid_t pid, const char* command_name, JobState state) {
     job->job_number = next_job_number++;
     job->pid = pid;
     job->state = state;
+    memset(&job->timeout, 0, sizeof(job->timeout));
+    job->output = NULL;
     if (command_name != NULL) {
         strncpy(job->command_name, command_name, sizeof(job->command_name) - 1);
         job->command_name[sizeof(job->command_name) - 1] = '\0';
@@ -53,6 +68,8 @@ static void remove_background_job_index(int index) {
     if (index < 0 || index >= background_job_count) {
         return;
     }
+    // Reaped: whatever it wrote and nobody read goes with it.
+    release_job_output(background_jobs[index].output);
     for (int i = index; i < background_job_count - 1; i++) {
         background_jobs[i] = background_jobs[i + 1];
     }
@@ -85,8 +102,10 @@ BackgroundJob* find_most_recent_job() {
     return NULL;
 }
 
-void check_background_jobs(void) {
+int check_background_jobs(void) {
     int status;
+    int notifications = 0;
+    timeout_enforce_jobs();
     for (int i = 0; i < background_job_count; ) {
         pid_t pid = background_jobs[i].pid;
         pid_t result = waitpid(pid, &status, WNOHANG | WUNTRACED | WCONTINUED);
@@ -110,18 +129,22 @@ void check_background_jobs(void) {
 
             if (WIFEXITED(status)) {
                 if (is_interactive_mode) {
+                    begin_notification();
                     if (WEXITSTATUS(status) == 0) {
                         fprintf(stderr, "%s with pid %d exited normally\n", name, (int)pid);
                     } else {
                         fprintf(stderr, "%s with pid %d exited abnormally\n", name, (int)pid);
                     }
                     fflush(stderr);
+                    notifications++;
                 }
                 remove_background_job_index(i);
             } else if (WIFSIGNALED(status)) {
                 if (is_interactive_mode) {
+                    begin_notification();
                     printf("[%d] Terminated %s\n", background_jobs[i].job_number, name);
                     fflush(stdout);
+                    notifications++;
                 }
                 remove_background_job_index(i);
             } else if (WIFSTOPPED(status)) {
@@ -133,6 +156,14 @@ void check_background_jobs(void) {
             }
         }
     }
+    return notifications;
+}
+
+int notify_background_jobs(void) {
+    erase_prompt_first = true;
+    int notifications = check_background_jobs();
+    erase_prompt_first = false;
+    return notifications;
 }
 
 static int compare_background_jobs(const void* a, const void* b) {
@@ -141,7 +172,7 @@ static int compare_background_jobs(const void* a, const void* b) {
 
 void list_activities(void) {
     check_background_jobs();
-    BackgroundJob active_jobs[256];
+    BackgroundJob active_jobs[MAX_JOBS];
     int active_jobs_count = 0;
     
     for(int i = 0; i < background_job_count; i++) {
@@ -154,6 +185,8 @@ void list_activities(void) {
 }
 
 void check_and_kill_all_jobs(void) {
+    // Idle zygotes are children too; they exit once their socket closes.
+    zygote_pool_shutdown();
     for (int i = 0; i < background_job_count; i++) {
         kill(-background_jobs[i].pid, SIGKILL);
     }
@@ -0,0 +1,307 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <termios.h>
+#include "../include/lineedit.h"
+#include "../include/log.h"
+#include "../include/completion.h"
+
+#define MAX_PROMPT_LENGTH 4096
+
+static struct termios original_termios;
+static bool have_original_termios = false;
+static bool editing = false;
+
+static char prompt[MAX_PROMPT_LENGTH];
+static char* buffer = NULL;
+static size_t buffer_length = 0;
+static size_t buffer_capacity = 0;
+static size_t cursor = 0;
+
+// Position while browsing history: history_count means the line being typed,
+// which is kept in saved_line while older entries are shown.
+static int history_index = 0;
+static char* saved_line = NULL;
+
+// Escape sequences can arrive split across reads, so they are collected
+// here until complete.
+static char escape[8];
+static size_t escape_length = 0;
+static bool last_key_was_tab = false;
+
+static void write_all(const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, length);
+        if (n <= 0) return;
+        data += n;
+        length -= (size_t)n;
+    }
+}
+
+static void write_string(const char* s) {
+    write_all(s, strlen(s));
+}
+
+static bool enable_raw_mode(void) {
+    if (!have_original_termios) {
+        if (tcgetattr(STDIN_FILENO, &original_termios) == -1) return false;
+        have_original_termios = true;
+    }
+    struct termios raw = original_termios;
+    // Output processing stays on so '\n' still returns the carriage.
+    raw.c_iflag &= ~(ICRNL | IXON | BRKINT | INPCK | ISTRIP);
+    raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    return tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == 0;
+}
+
+static bool ensure_capacity(size_t needed) {
+    if (needed + 1 <= buffer_capacity) return true;
+    size_t new_capacity = buffer_capacity ? buffer_capacity : 256;
+    while (new_capacity < needed + 1) new_capacity *= 2;
+    char* new_buffer = realloc(buffer, new_capacity);
+    if (!new_buffer) return false;
+    buffer = new_buffer;
+    buffer_capacity = new_capacity;
+    return true;
+}
+
+static void set_line(const char* text) {
+    size_t length = strlen(text);
+    if (!ensure_capacity(length)) return;
+    memcpy(buffer, text, length + 1);
+    buffer_length = cursor = length;
+}
+
+void line_editor_redraw(void) {
+    if (!editing) return;
+    char move[32];
+    write_string("\r");
+    write_string(prompt);
+    write_all(buffer, buffer_length);
+    write_string("\033[K");
+    if (cursor < buffer_length) {
+        snprintf(move, sizeof(move), "\033[%zuD", buffer_length - cursor);
+        write_string(move);
+    }
+}
+
+void line_editor_begin(const char* new_prompt) {
+    strncpy(prompt, new_prompt, sizeof(prompt) - 1);
+    prompt[sizeof(prompt) - 1] = '\0';
+    if (!ensure_capacity(0)) return;
+    buffer[0] = '\0';
+    buffer_length = cursor = 0;
+    escape_length = 0;
+    last_key_was_tab = false;
+    sync_history();
+    history_index = get_history_count();
+    free(saved_line);
+    saved_line = NULL;
+
+    editing = enable_raw_mode();
+    if (editing) {
+        line_editor_redraw();
+    } else {
+        write_string(prompt);
+    }
+}
+
+void line_editor_end(void) {
+    if (have_original_termios) {
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &original_termios);
+    }
+    editing = false;
+}
+
+bool line_editor_active(void) {
+    return editing;
+}
+
+static void insert_text(const char* text, size_t length) {
+    if (!ensure_capacity(buffer_length + length)) return;
+    memmove(buffer + cursor + length, buffer + cursor, buffer_length - cursor + 1);
+    memcpy(buffer + cursor, text, length);
+    buffer_length += length;
+    cursor += length;
+}
+
+static void delete_range(size_t from, size_t to) {
+    memmove(buffer + from, buffer + to, buffer_length - to + 1);
+    buffer_length -= to - from;
+    cursor = from;
+}
+
+static void show_history_entry(int index) {
+    int count = get_history_count();
+    if (index < 0 || index > count) return;
+    if (history_index == count) {
+        free(saved_line);
+        saved_line = strdup(buffer);
+    }
+    history_index = index;
+    if (index == count) {
+        set_line(saved_line ? saved_line : "");
+    } else {
+        set_line(get_history_entry(index));
+    }
+}
+
+static bool is_word_break(char c) {
+    return c == ' ' || c == '\t' || strchr("|&;<>", c) != NULL;
+}
+
+static void complete_at_cursor(void) {
+    size_t start = cursor;
+    while (start > 0 && !is_word_break(buffer[start - 1])) {
+        start--;
+    }
+    size_t before = start;
+    while (before > 0 && (buffer[before - 1] == ' ' || buffer[before - 1] == '\t')) {
+        before--;
+    }
+    bool command_position = (before == 0 || strchr("|&;", buffer[before - 1]) != NULL);
+
+    char* word = strndup(buffer + start, cursor - start);
+    if (!word) return;
+    CompletionList list = { NULL, 0, 0, 0, NULL };
+    complete_word(word, command_position, &list);
+
+    size_t word_length = strlen(word);
+    if (list.total == 0) {
+        write_string("\a");
+    } else if (list.total == 1 && list.count == 1) {
+        const char* match = list.items[0];
+        insert_text(match + word_length, strlen(match) - word_length);
+        if (match[strlen(match) - 1] != '/') insert_text(" ", 1);
+    } else if (list.common != NULL && strlen(list.common) > word_length) {
+        insert_text(list.common + word_length, strlen(list.common) - word_length);
+    } else if (last_key_was_tab) {
+        // Second Tab with nothing left to add lists the candidates.
+        char more[64];
+        write_string("\r\n");
+        for (int i = 0; i < list.count; i++) {
+            write_string(list.items[i]);
+            write_string("  ");
+        }
+        if (list.total > list.count) {
+            snprintf(more, sizeof(more), "(%d more)", list.total - list.count);
+            write_string(more);
+        }
+        write_string("\r\n");
+    } else {
+        write_string("\a");
+    }
+    free_completion_list(&list);
+    free(word);
+}
+
+// Handles a complete escape sequence (arrow keys, Home/End, Delete).
+static void handle_escape(void) {
+    if (escape_length < 3) return;
+    char key = escape[escape_length - 1];
+    if (key == '~') {
+        if (escape[2] == '3' && cursor < buffer_length) delete_range(cursor, cursor + 1);
+        else if (escape[2] == '1' || escape[2] == '7') cursor = 0;
+        else if (escape[2] == '4' || escape[2] == '8') cursor = buffer_length;
+        return;
+    }
+    switch (key) {
+        case 'A': show_history_entry(history_index - 1); break;
+        case 'B': show_history_entry(history_index + 1); break;
+        case 'C': if (cursor < buffer_length) cursor++; break;
+        case 'D': if (cursor > 0) cursor--; break;
+        case 'H': cursor = 0; break;
+        case 'F': cursor = buffer_length; break;
+        default: break;
+    }
+}
+
+EditResult line_editor_feed(const char* bytes, size_t length, size_t* consumed, char** line) {
+    *line = NULL;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)bytes[i];
+
+        if (escape_length > 0) {
+            escape[escape_length++] = (char)c;
+            // ESC [ params final, or ESC O final.
+            bool complete = (escape_length >= 3 && (c >= 0x40 && c <= 0x7e)) ||
+                            (escape_length == 2 && c != '[' && c != 'O') ||
+                            escape_length == sizeof(escape);
+            if (complete) {
+                handle_escape();
+                escape_length = 0;
+                line_editor_redraw();
+            }
+            continue;
+        }
+
+        bool tab = false;
+        switch (c) {
+            case '\r':
+            case '\n':
+                *consumed = i + 1;
+                write_string("\r\n");
+                *line = strdup(buffer);
+                line_editor_end();
+                return EDIT_LINE;
+            case 3: // Ctrl-C
+                *consumed = i + 1;
+                write_string("^C\r\n");
+                line_editor_end();
+                return EDIT_INTERRUPT;
+            case 4: // Ctrl-D
+                if (buffer_length == 0) {
+                    *consumed = i + 1;
+                    line_editor_end();
+                    return EDIT_EOF;
+                }
+                if (cursor < buffer_length) delete_range(cursor, cursor + 1);
+                break;
+            case 27:
+                escape[0] = 27;
+                escape_length = 1;
+                continue;
+            case 127:
+            case 8:
+                if (cursor > 0) delete_range(cursor - 1, cursor);
+                break;
+            case '\t':
+                complete_at_cursor();
+                tab = true;
+                break;
+            case 1: cursor = 0; break;                         // Ctrl-A
+            case 5: cursor = buffer_length; break;             // Ctrl-E
+            case 2: if (cursor > 0) cursor--; break;           // Ctrl-B
+            case 6: if (cursor < buffer_length) cursor++; break; // Ctrl-F
+            case 11: delete_range(cursor, buffer_length); break; // Ctrl-K
+            case 21: delete_range(0, cursor); break;           // Ctrl-U
+            case 16: show_history_entry(history_index - 1); break; // Ctrl-P
+            case 14: show_history_entry(history_index + 1); break; // Ctrl-N
+            case 23: { // Ctrl-W
+                size_t start = cursor;
+                while (start > 0 && buffer[start - 1] == ' ') start--;
+                while (start > 0 && buffer[start - 1] != ' ') start--;
+                delete_range(start, cursor);
+                break;
+            }
+            case 12: // Ctrl-L
+                write_string("\033[H\033[2J");
+                break;
+            default:
+                if (c >= 32) {
+                    char ch = (char)c;
+                    insert_text(&ch, 1);
+                }
+                break;
+        }
+        last_key_was_tab = tab;
+        line_editor_redraw();
+    }
+    *consumed = length;
+    return EDIT_PENDING;
+}
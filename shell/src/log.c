@@ -1,9 +1,15 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
 #include <pwd.h>
 #include <ctype.h>
 #include "../include/log.h"
@@ -11,14 +17,29 @@
 #include "../include/parser.h"
 #include "../include/hop.h"
 #include "../include/reveal.h"
+#include "../include/ast.h"
 
 #define MAX_HISTORY_SIZE 15
 #define HISTORY_FILE_NAME ".shell_history"
 #define MAX_PATH_LENGTH 1024
+// Past this size the file is rewritten, in the background, down to the
+// newest HISTORY_KEEP_ENTRIES entries.
+#define HISTORY_COMPACT_SIZE (256 * 1024)
+#define HISTORY_KEEP_ENTRIES 1000
 
+// The newest entries of the shared file, from every session.
 static char* history[MAX_HISTORY_SIZE];
 static int history_count = 0;
 
+// The file is shared by every running shell. Each entry is one line,
+// "<unix time>\t<session id>\t<command>", appended with a single write()
+// under flock(). Sessions pick up each other's entries by reading on from
+// history_offset; a rewrite replaces the file, which readers notice by its
+// inode.
+static int history_fd = -1;
+static off_t history_offset = 0;
+static char session_id[32];
+
 static void get_history_file_path(char* path_buffer) {
     const char* home_dir = getenv("HOME");
     if (!home_dir) {
@@ -29,88 +50,264 @@ static void get_history_file_path(char* path_buffer) {
     snprintf(path_buffer, MAX_PATH_LENGTH, "%s/%s", home_dir, HISTORY_FILE_NAME);
 }
 
-static void load_history() {
-    char history_file_path[MAX_PATH_LENGTH];
-    get_history_file_path(history_file_path);
-    FILE* fp = fopen(history_file_path, "r");
-    if (!fp) return; 
+static void remember(const char* command) {
+    char* copy = strdup(command);
+    if (!copy) return;
+    if (history_count >= MAX_HISTORY_SIZE) {
+        free(history[0]);
+        for (int i = 1; i < MAX_HISTORY_SIZE; i++) {
+            history[i - 1] = history[i];
+        }
+        history[MAX_HISTORY_SIZE - 1] = copy;
+    } else {
+        history[history_count++] = copy;
+    }
+}
 
-    char* line = NULL;
-    size_t len = 0;
-    while (getline(&line, &len, fp) != -1) {
-        line[strcspn(line, "\n")] = '\0';
-        if (history_count < MAX_HISTORY_SIZE) {
-            history[history_count++] = strdup(line);
+static void forget_history(void) {
+    for (int i = 0; i < history_count; i++) {
+        free(history[i]);
+        history[i] = NULL;
+    }
+    history_count = 0;
+}
+
+// True if fd no longer is the file at path, because it was rewritten.
+static bool file_replaced(int fd, const char* path) {
+    struct stat by_path, by_fd;
+    if (stat(path, &by_path) != 0 || fstat(fd, &by_fd) != 0) return true;
+    return by_path.st_ino != by_fd.st_ino || by_path.st_dev != by_fd.st_dev;
+}
+
+static bool reopen_history(const char* path) {
+    if (history_fd != -1) close(history_fd);
+    history_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    history_offset = 0;
+    forget_history();
+    return history_fd != -1;
+}
+
+// Skips the time and session fields. Lines written before they existed are
+// taken whole.
+static const char* entry_command(const char* line) {
+    const char* p = line;
+    while (isdigit((unsigned char)*p)) p++;
+    if (p == line || *p != '\t') return line;
+    const char* session_end = strchr(p + 1, '\t');
+    return session_end ? session_end + 1 : line;
+}
+
+// Reads the complete lines between history_offset and size.
+static void read_new_entries(off_t size) {
+    char buffer[65536];
+    size_t kept = 0;
+    while (history_offset + (off_t)kept < size) {
+        ssize_t n = pread(history_fd, buffer + kept, sizeof(buffer) - 1 - kept, history_offset + (off_t)kept);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        size_t length = kept + (size_t)n;
+        size_t start = 0;
+        for (size_t i = 0; i < length; i++) {
+            if (buffer[i] != '\n') continue;
+            buffer[i] = '\0';
+            if (i > start) remember(entry_command(buffer + start));
+            start = i + 1;
+        }
+        history_offset += (off_t)start;
+        // An entry longer than the buffer is skipped.
+        if (start == 0 && length == sizeof(buffer) - 1) {
+            history_offset += (off_t)length;
+            start = length;
         }
+        kept = length - start;
+        memmove(buffer, buffer + start, kept);
     }
-    free(line);
-    fclose(fp);
 }
 
-static void save_history() {
-    char history_file_path[MAX_PATH_LENGTH];
-    get_history_file_path(history_file_path);
-    FILE* fp = fopen(history_file_path, "w");
-    if (!fp) {
+void sync_history(void) {
+    char path[MAX_PATH_LENGTH];
+    get_history_file_path(path);
+    if (history_fd == -1 || file_replaced(history_fd, path)) {
+        if (!reopen_history(path)) return;
+    }
+    struct stat st;
+    if (fstat(history_fd, &st) != 0) return;
+    if (st.st_size < history_offset) {
+        // Truncated by hand.
+        history_offset = 0;
+        forget_history();
+    }
+    if (st.st_size > history_offset) read_new_entries(st.st_size);
+}
+
+// Locks the current history file, following it if it is replaced while
+// waiting for the lock. Returns false if it cannot be opened.
+static bool lock_history(void) {
+    char path[MAX_PATH_LENGTH];
+    get_history_file_path(path);
+    for (;;) {
+        sync_history();
+        if (history_fd == -1) return false;
+        while (flock(history_fd, LOCK_EX) == -1) {
+            if (errno != EINTR) return false;
+        }
+        if (!file_replaced(history_fd, path)) {
+            // Entries appended before the lock was granted.
+            sync_history();
+            return true;
+        }
+        flock(history_fd, LOCK_UN);
+    }
+}
+
+// Replaces the file with its newest keep entries. Runs under the lock of
+// fd, which stays on the old file, so that writers waiting for it retry on
+// the new one.
+static void rewrite_history(int fd, const char* path, int keep) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return;
+    char* data = malloc((size_t)st.st_size + 1);
+    if (!data) return;
+    size_t length = 0;
+    while (keep > 0 && length < (size_t)st.st_size) {
+        ssize_t n = pread(fd, data + length, (size_t)st.st_size - length, (off_t)length);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        length += (size_t)n;
+    }
+    size_t start = length;
+    for (int lines = 0; start > 0; start--) {
+        if (data[start - 1] == '\n' && start != length && ++lines == keep) break;
+    }
+
+    char temp_path[MAX_PATH_LENGTH + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", path, (int)getpid());
+    int out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out == -1) {
+        free(data);
+        return;
+    }
+    bool ok = true;
+    for (size_t done = start; done < length && ok; ) {
+        ssize_t n = write(out, data + done, length - done);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) ok = false;
+        else done += (size_t)n;
+    }
+    if (ok && fdatasync(out) == 0 && rename(temp_path, path) == 0) {
+        close(out);
+    } else {
+        close(out);
+        unlink(temp_path);
+    }
+    free(data);
+}
+
+// Compacts the file in a detached grandchild, so neither this shell nor
+// the other sessions wait for it beyond the lock.
+static void start_compaction(void) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == -1) return;
+    if (pid == 0) {
+        if (fork() == 0) {
+            close_range(3, ~0U, 0);
+            char path[MAX_PATH_LENGTH];
+            get_history_file_path(path);
+            int fd = open(path, O_RDWR | O_CLOEXEC);
+            if (fd != -1 && flock(fd, LOCK_EX) == 0 && !file_replaced(fd, path)) {
+                // Another session may have compacted it first.
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > HISTORY_COMPACT_SIZE) {
+                    rewrite_history(fd, path, HISTORY_KEEP_ENTRIES);
+                }
+            }
+            _exit(0);
+        }
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+static void append_to_history(const char* command) {
+    if (!lock_history()) {
         perror("Failed to save history");
         return;
     }
-    for (int i = 0; i < history_count; i++) {
-        fprintf(fp, "%s\n", history[i]);
+    // Compared with the newest entry of any session, now that it is read.
+    if (history_count > 0 && strcmp(history[history_count - 1], command) == 0) {
+        flock(history_fd, LOCK_UN);
+        return;
     }
-    fclose(fp);
+
+    if (session_id[0] == '\0') {
+        snprintf(session_id, sizeof(session_id), "%lx-%d", (long)time(NULL), (int)getpid());
+    }
+    char* line = NULL;
+    int length = asprintf(&line, "%lld\t%s\t%s\n", (long long)time(NULL), session_id, command);
+    if (length > 0 && write(history_fd, line, (size_t)length) != length) {
+        perror("Failed to save history");
+    }
+    free(line);
+    // Read back through the offset like any other session's entry.
+    sync_history();
+    bool compact = history_offset > HISTORY_COMPACT_SIZE;
+    flock(history_fd, LOCK_UN);
+    if (compact) start_compaction();
 }
 
 static void print_history() {
+    sync_history();
     for (int i = 0; i < history_count; i++) {
         printf("%s\n", history[i]);
     }
 }
 
 static void purge_history() {
-    for (int i = 0; i < history_count; i++) {
-        free(history[i]);
-        history[i] = NULL;
+    if (!lock_history()) {
+        perror("Failed to save history");
+        return;
     }
-    history_count = 0;
-    save_history();
-    // char history_file_path[MAX_PATH_LENGTH];
-    // get_history_file_path(history_file_path);
-    // FILE* fp = fopen(history_file_path, "w"); // Open in "w" mode to clear it
-    // if (fp) {
-    //     fclose(fp); // Immediately close it, leaving it empty.
-    // }
+    char path[MAX_PATH_LENGTH];
+    get_history_file_path(path);
+    rewrite_history(history_fd, path, 0);
+    flock(history_fd, LOCK_UN);
+    sync_history();
 }
 
 static void execute_from_history(int index, char** prev_dir, const char* home_dir) {
+    sync_history();
     if (index > 0 && index <= history_count) {
         int oldest_to_newest_index = history_count - index;
         char* command = history[oldest_to_newest_index];
-        char* line_copy = strdup(command);
-        if (!line_copy) {
-            perror("strdup failed");
-            return;
-        }
+        ArgVector tokens = ARG_VECTOR_INIT;
+        tokenize_input(command, &tokens);
 
-        char* tokens[100];
-        int token_count = 0;
-        tokenize_input(line_copy, tokens, &token_count);
-
-        if (token_count > 0) {
-            if (strcmp(tokens[0], "log") == 0) {
+        if (tokens.count > 0) {
+            if (strcmp(tokens.items[0], "log") == 0) {
                 fprintf(stderr, "Cannot execute 'log' command from history.\n");
             } else {
-                execute(tokens, token_count, prev_dir, (char*)home_dir);
+                run_tokens(tokens.items, tokens.count, prev_dir, (char*)home_dir);
             }
         }
-        free(line_copy);
+        arg_vector_free(&tokens);
     } else {
         fprintf(stderr, "Invalid history index.\n");
     }
 }
 
+int get_history_count(void) {
+    return history_count;
+}
+
+const char* get_history_entry(int index) {
+    if (index < 0 || index >= history_count) return NULL;
+    return history[index];
+}
+
 void init_log() {
-    load_history();
+    sync_history();
 }
 
 void add_to_log(const char* command) {
@@ -167,21 +364,7 @@ void add_to_log(const char* command) {
         return;
     }
 
-    if (history_count > 0 && strcmp(history[history_count - 1], command) == 0) {
-        return;
-    }
-
-    if (history_count >= MAX_HISTORY_SIZE) {
-        free(history[0]);
-        for (int i = 1; i < MAX_HISTORY_SIZE; i++) {
-            history[i - 1] = history[i];
-        }
-        history[MAX_HISTORY_SIZE - 1] = strdup(command);
-    } else {
-        history[history_count++] = strdup(command);
-    }
-
-    save_history();
+    append_to_history(command);
 }
 
 bool handle_log_command(char** args, int num_args, char** prev_dir, const char* home_dir) {
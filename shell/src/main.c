@@ -16,36 +16,53 @@
 #include "../include/executor.h"
 #include "../include/signals.h"
 #include "../include/jobs.h"
+#include "../include/expand.h"
+#include "../include/script.h"
+#include "../include/eventloop.h"
+#include "../include/lineedit.h"
+#include "../include/completion.h"
+#include "../include/ast.h"
+#include "../include/zygote.h"
+#include "../include/server.h"
+#include "../include/replay.h"
 
 // Global variables, now accessible via 'extern' in other files
 bool is_interactive_mode = true;
 pid_t foreground_pid = -1;
+int last_exit_status = 0;
 
 #define MAX_BUFFER_SIZE 4096
 
 char SHELL_HOME_DIR[MAX_BUFFER_SIZE];
 
-void display_prompt() {
+static char* prev_dir = NULL;
+
+// Bytes read from stdin that do not form a complete line yet.
+static char* input_buffer = NULL;
+static size_t input_length = 0;
+static size_t input_capacity = 0;
+
+static bool build_prompt(char* prompt, size_t size) {
     char hostname[MAX_BUFFER_SIZE];
-    char cwd[MAX_BUFFER_SIZE];
     char display_path[MAX_BUFFER_SIZE];
 
     uid_t uid = geteuid();
     struct passwd *pw = getpwuid(uid);
     if (pw == NULL) {
         perror("getpwuid failed");
-        return;
+        return false;
     }
     char *username = pw->pw_name;
     
     if (gethostname(hostname, sizeof(hostname)) != 0) {
         perror("gethostname failed");
-        return;
+        return false;
     }
     
-    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+    const char* cwd = current_directory();
+    if (cwd == NULL) {
         perror("getcwd failed");
-        return;
+        return false;
     }
 
     if (strstr(cwd, SHELL_HOME_DIR) == cwd) {
@@ -55,108 +72,306 @@ void display_prompt() {
         strncpy(display_path, cwd, sizeof(display_path));
     }
     
-    printf("<%s@%s:%s> ", username, hostname, display_path);
-    fflush(stdout);
+    snprintf(prompt, size, "<%s@%s:%s> ", username, hostname, display_path);
+    return true;
 }
 
-int main() {
-    is_interactive_mode = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) && isatty(STDERR_FILENO);
-    
-    char *line = NULL;
-    size_t len = 0;
-    
-    char* prev_dir = NULL;
+void display_prompt() {
+    char prompt[3 * MAX_BUFFER_SIZE];
+    if (build_prompt(prompt, sizeof(prompt))) {
+        printf("%s", prompt);
+        fflush(stdout);
+    }
+}
 
-    if (getcwd(SHELL_HOME_DIR, sizeof(SHELL_HOME_DIR)) == NULL) {
-        perror("getcwd failed");
-        return 1;
+static void process_line(char* line) {
+    if (strlen(line) == 0 || strspn(line, " \t\n\r") == strlen(line)) {
+        return;
     }
 
-    if (is_interactive_mode) {
-        setup_signal_handlers();
-    } else {
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
+    add_to_log(line);
+    record_begin(line);
+
+    if (!parse_input(line)) {
+        printf("Invalid Syntax!\n");
+        record_end();
+        return;
     }
-    
-    init_log();
+    record_parsed();
 
-    while (1) {
-        if (is_interactive_mode) {
-            check_background_jobs();
-            display_prompt();
-        }
-        
-        ssize_t rd = getline(&line, &len, stdin);
-        
-        if (rd == -1) {
-            if (feof(stdin)) {
-                check_and_kill_all_jobs();
-                printf("\nlogout\n");
-                exit(0);
-            } else if (errno == EINTR) {
-                printf("\n");
-                continue;
+    ArgVector tokens = ARG_VECTOR_INIT;
+    tokenize_input(line, &tokens);
+    record_tokenized();
+
+    if (tokens.count > 0) {
+        run_tokens(tokens.items, tokens.count, &prev_dir, SHELL_HOME_DIR);
+    }
+
+    arg_vector_free(&tokens);
+    record_end();
+}
+
+// "-c STRING": each line of STRING as if read from a script.
+static void run_command_string(char* commands) {
+    char* line = commands;
+    while (line != NULL) {
+        char* newline = strchr(line, '\n');
+        if (newline) *newline = '\0';
+        // Only blank lines may follow the last line.
+        bool last = newline == NULL || newline[1 + strspn(newline + 1, " \t\r\n")] == '\0';
+        size_t skip = strspn(line, " \t\r");
+        if (line[skip] != '\0' && line[skip] != '#') {
+            if (!parse_input(line)) {
+                printf("Invalid Syntax!\n");
+                last_exit_status = 2;
             } else {
-                perror("getline");
-                exit(1);
+                ArgVector tokens = ARG_VECTOR_INIT;
+                tokenize_input(line, &tokens);
+                if (last) run_last_tokens(tokens.items, tokens.count, &prev_dir, SHELL_HOME_DIR);
+                else run_tokens(tokens.items, tokens.count, &prev_dir, SHELL_HOME_DIR);
+                arg_vector_free(&tokens);
             }
         }
+        line = newline ? newline + 1 : NULL;
+    }
+    if (command_pending()) {
+        printf("Invalid Syntax!\n");
+        last_exit_status = 2;
+    }
+}
+
+static void handle_end_of_input(void) {
+    check_and_kill_all_jobs();
+    printf("\nlogout\n");
+    exit(0);
+}
+
+static void show_prompt(void) {
+    if (is_interactive_mode) {
+        check_background_jobs();
+        path_index_refresh();
+        char prompt[3 * MAX_BUFFER_SIZE];
+        if (command_pending()) {
+            line_editor_begin("> ");
+        } else if (build_prompt(prompt, sizeof(prompt))) {
+            line_editor_begin(prompt);
+        }
+    }
+}
 
-        line[strcspn(line, "\n")] = '\0';
+static void redraw_prompt(void) {
+    if (line_editor_active()) {
+        line_editor_redraw();
+    } else {
+        display_prompt();
+    }
+}
+
+// Keyboard input while the line editor owns the terminal. Typed-ahead
+// bytes left over after a finished line go to the next prompt's editor.
+static void handle_terminal_input(int fd) {
+    char bytes[MAX_BUFFER_SIZE];
+    ssize_t rd = read(fd, bytes, sizeof(bytes));
+    if (rd == -1) {
+        if (errno == EINTR || errno == EAGAIN) return;
+        perror("read");
+        exit(1);
+    }
+    if (rd == 0) {
+        line_editor_end();
+        handle_end_of_input();
+    }
 
-        if (strlen(line) == 0 || strspn(line, " \t\n\r") == strlen(line)) {
-            continue;
+    size_t offset = 0;
+    while (offset < (size_t)rd) {
+        size_t consumed = 0;
+        char* line = NULL;
+        if (!line_editor_active()) {
+            show_prompt();
+            if (!line_editor_active()) return;
         }
+        EditResult result = line_editor_feed(bytes + offset, (size_t)rd - offset, &consumed, &line);
+        offset += consumed;
+        if (result == EDIT_LINE) {
+            process_line(line);
+            free(line);
+            show_prompt();
+        } else if (result == EDIT_EOF) {
+            handle_end_of_input();
+        } else if (result == EDIT_INTERRUPT) {
+            show_prompt();
+        }
+    }
+}
 
-        add_to_log(line);
+static void handle_stdin(int fd, void* data) {
+    (void)data;
+    if (line_editor_active()) {
+        handle_terminal_input(fd);
+        return;
+    }
 
-        if (!parse_input(line)) {
-            printf("Invalid Syntax!\n");
-            continue;
+    if (input_capacity - input_length < MAX_BUFFER_SIZE) {
+        size_t new_capacity = input_capacity ? input_capacity * 2 : 2 * MAX_BUFFER_SIZE;
+        char* new_buffer = realloc(input_buffer, new_capacity);
+        if (!new_buffer) {
+            perror("realloc");
+            exit(1);
         }
+        input_buffer = new_buffer;
+        input_capacity = new_capacity;
+    }
 
-        char* line_copy = strdup(line);
-        if (!line_copy) {
-            perror("strdup");
-            continue;
+    ssize_t rd = read(fd, input_buffer + input_length, input_capacity - input_length - 1);
+    if (rd == -1) {
+        if (errno == EINTR || errno == EAGAIN) return;
+        perror("read");
+        exit(1);
+    }
+    if (rd == 0) {
+        // A final line without a trailing newline still runs.
+        if (input_length > 0) {
+            input_buffer[input_length] = '\0';
+            input_length = 0;
+            process_line(input_buffer);
         }
+        handle_end_of_input();
+    }
+    input_length += (size_t)rd;
 
-        char* tokens[1024];
-        int token_count = 0;
-        tokenize_input(line_copy, tokens, &token_count);
-
-        if (token_count > 0) {
-            char* expanded_args[1024];
-            bool needs_free[1024] = {false};
-
-            for (int i = 0; i < token_count; i++) {
-                if (tokens[i][0] == '~') {
-                    char buffer[4096];
-                    snprintf(buffer, sizeof(buffer), "%s%s", SHELL_HOME_DIR, tokens[i] + 1);
-                    expanded_args[i] = strdup(buffer);
-                    needs_free[i] = true;
-                } else {
-                    expanded_args[i] = tokens[i];
-                }
-            }
-            expanded_args[token_count] = NULL;
+    size_t consumed = 0;
+    char* newline;
+    while ((newline = memchr(input_buffer + consumed, '\n', input_length - consumed)) != NULL) {
+        *newline = '\0';
+        char* line = input_buffer + consumed;
+        consumed = (size_t)(newline - input_buffer) + 1;
+        process_line(line);
+    }
+    memmove(input_buffer, input_buffer + consumed, input_length - consumed);
+    input_length -= consumed;
 
-            execute(expanded_args, token_count, &prev_dir, SHELL_HOME_DIR);
+    if (consumed > 0) {
+        show_prompt();
+    }
+}
 
-            for (int i = 0; i < token_count; i++) {
-                if (needs_free[i]) {
-                    free(expanded_args[i]);
-                }
+static void handle_signal_event(int fd, void* data) {
+    (void)data;
+    int signo;
+    while ((signo = read_pending_signal(fd)) != 0) {
+        if (signo == SIGINT) {
+            handle_sigint(signo);
+            // At the prompt Ctrl-C abandons the current line.
+            printf("\n");
+            show_prompt();
+        } else if (signo == SIGTSTP) {
+            handle_sigtstp(signo);
+        } else if (signo == SIGCHLD) {
+            if (notify_background_jobs() > 0) {
+                redraw_prompt();
             }
         }
+    }
+}
 
-        free(line_copy);
+int main(int argc, char** argv) {
+    // "shell.out [--zygotes N] [--record FILE] [-c COMMANDS | script]". A
+    // script, -c or --replay runs non-interactively.
+    int arg_index = 1;
+    int zygote_count = 0;
+    const char* server_path = NULL;
+    const char* record_path = NULL;
+    const char* replay_path = NULL;
+    bool max_speed = false;
+    char* command_string = NULL;
+    while (arg_index < argc && !command_string && argv[arg_index][0] == '-') {
+        if (strcmp(argv[arg_index], "-c") == 0 && arg_index + 1 < argc) {
+            command_string = argv[arg_index + 1];
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--zygotes") == 0 && arg_index + 1 < argc) {
+            zygote_count = atoi(argv[arg_index + 1]);
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--server") == 0 && arg_index + 1 < argc) {
+            server_path = argv[arg_index + 1];
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--record") == 0 && arg_index + 1 < argc) {
+            record_path = argv[arg_index + 1];
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--replay") == 0 && arg_index + 1 < argc) {
+            replay_path = argv[arg_index + 1];
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--max-speed") == 0) {
+            max_speed = true;
+            arg_index++;
+        } else if (strcmp(argv[arg_index], "--client") == 0 && arg_index + 1 < argc) {
+            // "--client SOCK [command...]" skips all shell startup.
+            return run_client(argv[arg_index + 1], argc - arg_index - 2, argv + arg_index + 2);
+        } else {
+            fprintf(stderr, "Usage: %s [--zygotes N] [--server SOCK] [--record FILE] [-c COMMANDS | script]\n"
+                            "       %s --replay FILE [--max-speed]\n"
+                            "       %s --client SOCK [command...]\n", argv[0], argv[0], argv[0]);
+            return 1;
+        }
+    }
+    const char* script_path = (arg_index < argc && !command_string) ? argv[arg_index] : NULL;
+    is_interactive_mode = !script_path && !server_path && !command_string && !replay_path && isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) && isatty(STDERR_FILENO);
+
+    if (getcwd(SHELL_HOME_DIR, sizeof(SHELL_HOME_DIR)) == NULL) {
+        perror("getcwd failed");
+        return 1;
+    }
+
+    int signal_fd = -1;
+    if (is_interactive_mode) {
+        signal_fd = setup_signal_handlers();
+    } else {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
     }
     
-    free(line);
-    if (prev_dir) {
+    init_log();
+    zygote_pool_init(zygote_count);
+
+    if (server_path) {
+        return run_server(server_path, &prev_dir, SHELL_HOME_DIR) ? 0 : 1;
+    }
+
+    if (replay_path) {
+        bool ok = run_replay(replay_path, max_speed, &prev_dir, SHELL_HOME_DIR);
+        check_and_kill_all_jobs();
+        free(prev_dir);
+        return ok ? last_exit_status : 1;
+    }
+
+    if (record_path && !record_open(record_path)) {
+        return 1;
+    }
+
+    if (command_string) {
+        run_command_string(command_string);
+        check_and_kill_all_jobs();
+        free(prev_dir);
+        return last_exit_status;
+    }
+
+    if (script_path) {
+        bool ok = run_script(script_path, &prev_dir, SHELL_HOME_DIR);
+        check_and_kill_all_jobs();
         free(prev_dir);
+        return ok ? last_exit_status : 1;
     }
+
+    if (!event_loop_init() || !event_loop_add_fd(STDIN_FILENO, handle_stdin, NULL)) {
+        return 1;
+    }
+    if (signal_fd != -1) {
+        event_loop_add_fd(signal_fd, handle_signal_event, NULL);
+    }
+
+    show_prompt();
+    event_loop_run();
+
+    free(input_buffer);
+    free(prev_dir);
     return 0;
 }
@@ -0,0 +1,350 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include "../include/monitor.h"
+#include "../include/jobs.h"
+#include "../include/signals.h"
+#include "../include/placement.h"
+
+// One process seen in /proc. Processes outside our jobs are remembered with
+// closed fds, so that each one is read only once.
+typedef struct {
+    pid_t pid;
+    pid_t pgid;
+    int stat_fd;
+    int statm_fd;
+    char comm[32];
+    char state;
+    int nice;
+    long threads;
+    unsigned long long ticks;       // utime + stime
+    unsigned long long start_ticks; // since boot
+    long rss_pages;
+    double cpu;                     // percent over the last interval
+    bool alive;
+} ProcessSample;
+
+typedef struct {
+    ProcessSample* items;
+    int count;
+    int capacity;
+} SampleList;
+
+typedef struct {
+    DIR* proc;
+    SampleList samples;
+    pid_t* pids;
+    int pid_capacity;
+    long ticks_per_second;
+    long page_size;
+    struct timespec last_refresh;
+} Monitor;
+
+static int compare_pids(const void* a, const void* b) {
+    pid_t x = *(const pid_t*)a, y = *(const pid_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double seconds_between(const struct timespec* from, const struct timespec* to) {
+    return (double)(to->tv_sec - from->tv_sec) + (double)(to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static ssize_t read_proc_file(int fd, char* buffer, size_t size) {
+    ssize_t n;
+    do {
+        n = pread(fd, buffer, size - 1, 0);
+    } while (n == -1 && errno == EINTR);
+    buffer[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+// Reads /proc/<pid>/stat. The command name is in parentheses and may itself
+// contain spaces and parentheses, so the fields are found from the last ')'.
+static bool read_stat(ProcessSample* sample) {
+    char buffer[1024];
+    if (read_proc_file(sample->stat_fd, buffer, sizeof(buffer)) <= 0) return false;
+    char* open = strchr(buffer, '(');
+    char* close = strrchr(buffer, ')');
+    if (!open || !close || close < open) return false;
+    size_t length = (size_t)(close - open - 1);
+    if (length >= sizeof(sample->comm)) length = sizeof(sample->comm) - 1;
+    memcpy(sample->comm, open + 1, length);
+    sample->comm[length] = '\0';
+
+    int pgid;
+    unsigned long long utime, stime;
+    if (sscanf(close + 2, "%c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %d %ld %*d %llu",
+               &sample->state, &pgid, &utime, &stime, &sample->nice, &sample->threads, &sample->start_ticks) != 7) {
+        return false;
+    }
+    sample->pgid = (pid_t)pgid;
+    sample->ticks = utime + stime;
+    return true;
+}
+
+static void read_statm(ProcessSample* sample) {
+    char buffer[256];
+    if (read_proc_file(sample->statm_fd, buffer, sizeof(buffer)) <= 0) return;
+    sscanf(buffer, "%*s %ld", &sample->rss_pages);
+}
+
+static void close_sample(ProcessSample* sample) {
+    if (sample->stat_fd != -1) close(sample->stat_fd);
+    if (sample->statm_fd != -1) close(sample->statm_fd);
+    sample->stat_fd = sample->statm_fd = -1;
+}
+
+static bool is_job_group(const pid_t* groups, int group_count, pid_t pgid) {
+    return bsearch(&pgid, groups, (size_t)group_count, sizeof(pid_t), compare_pids) != NULL;
+}
+
+// Starts following a process: keeps its stat and statm open if it belongs
+// to one of the jobs.
+static void open_sample(Monitor* monitor, ProcessSample* sample, pid_t pid, const pid_t* groups, int group_count) {
+    memset(sample, 0, sizeof(*sample));
+    sample->pid = pid;
+    sample->stat_fd = sample->statm_fd = -1;
+    char path[64];
+    snprintf(path, sizeof(path), "%d/stat", (int)pid);
+    sample->stat_fd = openat(dirfd(monitor->proc), path, O_RDONLY | O_CLOEXEC);
+    if (sample->stat_fd == -1) return;
+    sample->alive = read_stat(sample);
+    if (!sample->alive || !is_job_group(groups, group_count, sample->pgid)) {
+        close_sample(sample);
+        return;
+    }
+    snprintf(path, sizeof(path), "%d/statm", (int)pid);
+    sample->statm_fd = openat(dirfd(monitor->proc), path, O_RDONLY | O_CLOEXEC);
+    if (sample->statm_fd != -1) read_statm(sample);
+    // First sight: CPU usage is known from the next refresh on.
+    sample->cpu = -1;
+}
+
+// Lists /proc and lines it up with the previous samples. Both are in pid
+// order, so processes are matched, added and dropped in one merge pass.
+static bool update_samples(Monitor* monitor, const pid_t* groups, int group_count, double elapsed) {
+    int pid_count = 0;
+    rewinddir(monitor->proc);
+    struct dirent* entry;
+    while ((entry = readdir(monitor->proc)) != NULL) {
+        if (!isdigit((unsigned char)entry->d_name[0])) continue;
+        if (pid_count == monitor->pid_capacity) {
+            int capacity = monitor->pid_capacity ? monitor->pid_capacity * 2 : 1024;
+            pid_t* grown = realloc(monitor->pids, (size_t)capacity * sizeof(pid_t));
+            if (!grown) return false;
+            monitor->pids = grown;
+            monitor->pid_capacity = capacity;
+        }
+        monitor->pids[pid_count++] = (pid_t)atoi(entry->d_name);
+    }
+    qsort(monitor->pids, (size_t)pid_count, sizeof(pid_t), compare_pids);
+
+    SampleList next = { malloc((size_t)(pid_count ? pid_count : 1) * sizeof(ProcessSample)), 0, pid_count };
+    if (!next.items) return false;
+    SampleList* old = &monitor->samples;
+    int o = 0;
+    for (int i = 0; i < pid_count; i++) {
+        pid_t pid = monitor->pids[i];
+        while (o < old->count && old->items[o].pid < pid) {
+            close_sample(&old->items[o++]);
+        }
+        ProcessSample* sample = &next.items[next.count++];
+        if (o < old->count && old->items[o].pid == pid) {
+            *sample = old->items[o++];
+            if (sample->stat_fd == -1) continue;
+            unsigned long long previous = sample->ticks;
+            sample->alive = read_stat(sample);
+            if (!sample->alive) continue;
+            read_statm(sample);
+            sample->cpu = elapsed > 0 ? (double)(sample->ticks - previous) * 100.0 / ((double)monitor->ticks_per_second * elapsed) : 0;
+        } else {
+            open_sample(monitor, sample, pid, groups, group_count);
+        }
+    }
+    while (o < old->count) {
+        close_sample(&old->items[o++]);
+    }
+    free(old->items);
+    *old = next;
+    return true;
+}
+
+static void format_duration(double seconds, char* buffer, size_t size) {
+    long total = seconds > 0 ? (long)seconds : 0;
+    snprintf(buffer, size, "%02ld:%02ld:%02ld", total / 3600, total / 60 % 60, total % 60);
+}
+
+static void format_memory(long pages, long page_size, char* buffer, size_t size) {
+    double kib = (double)pages * (double)page_size / 1024.0;
+    if (kib >= 1024.0 * 1024.0) snprintf(buffer, size, "%.1fG", kib / (1024.0 * 1024.0));
+    else if (kib >= 1024.0) snprintf(buffer, size, "%.1fM", kib / 1024.0);
+    else snprintf(buffer, size, "%.0fK", kib);
+}
+
+// Nice value, I/O class and CPUs of a process, or dashes without one.
+static void format_settings(const ProcessSample* p, char nice[8], char io[8], char cpus[16]) {
+    if (p == NULL) {
+        strcpy(nice, "-");
+        strcpy(io, "-");
+        strcpy(cpus, "-");
+        return;
+    }
+    snprintf(nice, 8, "%d", p->nice);
+    format_ioprio(p->pid, io, 8);
+    format_cpus(p->pid, cpus, 16);
+}
+
+static int compare_members(const void* a, const void* b) {
+    const ProcessSample* x = *(const ProcessSample* const*)a;
+    const ProcessSample* y = *(const ProcessSample* const*)b;
+    if (x->pgid != y->pgid) return (x->pgid > y->pgid) - (x->pgid < y->pgid);
+    return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+static void render(Monitor* monitor, double interval, int max_rows) {
+    // The job's processes, grouped by pgid.
+    SampleList* samples = &monitor->samples;
+    ProcessSample** members = malloc((size_t)(samples->count ? samples->count : 1) * sizeof(ProcessSample*));
+    if (!members) return;
+    int member_count = 0;
+    for (int i = 0; i < samples->count; i++) {
+        if (samples->items[i].stat_fd != -1 && samples->items[i].alive) {
+            members[member_count++] = &samples->items[i];
+        }
+    }
+    qsort(members, (size_t)member_count, sizeof(ProcessSample*), compare_members);
+
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    double uptime = (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+    double hz = (double)monitor->ticks_per_second;
+
+    int rows = 2;
+    printf("Every %.1fs: %d jobs, %d processes\n", interval, background_job_count, member_count);
+    printf("%-8s %8s %5s %6s %8s %9s %3s %5s %-9s  %s\n", "JOB", "PID", "THR", "CPU%", "RSS", "ELAPSED", "NI", "IO", "CPUS", "COMMAND");
+    for (int j = 0; j < background_job_count && (max_rows <= 0 || rows < max_rows); j++) {
+        BackgroundJob* job = &background_jobs[j];
+        int first = 0, last = member_count;
+        // Binary search for the job's first process.
+        while (first < last) {
+            int mid = (first + last) / 2;
+            if (members[mid]->pgid < job->pid) first = mid + 1;
+            else last = mid;
+        }
+        long threads = 0, rss = 0;
+        double cpu = 0, elapsed = 0;
+        int end = first;
+        // The job row shows the settings of the group leader, or failing
+        // that of its first process.
+        const ProcessSample* leader = first < member_count && members[first]->pgid == job->pid ? members[first] : NULL;
+        for (; end < member_count && members[end]->pgid == job->pid; end++) {
+            ProcessSample* p = members[end];
+            threads += p->threads;
+            rss += p->rss_pages;
+            if (p->cpu > 0) cpu += p->cpu;
+            double age = uptime - (double)p->start_ticks / hz;
+            if (age > elapsed) elapsed = age;
+            if (p->pid == job->pid) leader = p;
+        }
+
+        char label[16], memory[16], duration[16], nice[8], io[8], cpus[16];
+        snprintf(label, sizeof(label), "[%d]", job->job_number);
+        format_memory(rss, monitor->page_size, memory, sizeof(memory));
+        format_duration(elapsed, duration, sizeof(duration));
+        format_settings(leader, nice, io, cpus);
+        printf("%-8s %8d %5ld %6.1f %8s %9s %3s %5s %-9s  %s - %s\n", label, (int)job->pid, threads, cpu, memory, duration,
+               nice, io, cpus, job->command_name, get_job_state_string(job->state));
+        rows++;
+        for (int m = first; m < end && (max_rows <= 0 || rows < max_rows); m++, rows++) {
+            ProcessSample* p = members[m];
+            char usage[16];
+            format_memory(p->rss_pages, monitor->page_size, memory, sizeof(memory));
+            format_duration(uptime - (double)p->start_ticks / hz, duration, sizeof(duration));
+            format_settings(p, nice, io, cpus);
+            if (p->cpu < 0) snprintf(usage, sizeof(usage), "-");
+            else snprintf(usage, sizeof(usage), "%.1f", p->cpu);
+            printf("%-8s %8d %5ld %6s %8s %9s %3s %5s %-9s  %c %s\n", "", (int)p->pid, p->threads, usage, memory, duration,
+                   nice, io, cpus, p->state, p->comm);
+        }
+    }
+    free(members);
+}
+
+int watch_activities(char** args, int arg_count) {
+    double interval = 2.0;
+    long refreshes = 0;
+    if (arg_count > 0) interval = atof(args[0]);
+    if (arg_count > 1) refreshes = atol(args[1]);
+    if (arg_count > 2 || interval <= 0) {
+        fprintf(stderr, "Syntax: activities -w [interval [count]]\n");
+        return 1;
+    }
+
+    Monitor monitor;
+    memset(&monitor, 0, sizeof(monitor));
+    monitor.proc = opendir("/proc");
+    if (!monitor.proc) {
+        perror("activities: /proc");
+        return 1;
+    }
+    monitor.ticks_per_second = sysconf(_SC_CLK_TCK);
+    monitor.page_size = sysconf(_SC_PAGESIZE);
+
+    bool on_terminal = isatty(STDOUT_FILENO);
+    pid_t* groups = malloc(MAX_JOBS * sizeof(pid_t));
+    int status = groups ? 0 : 1;
+    for (long n = 0; groups && (refreshes == 0 || n < refreshes); n++) {
+        check_background_jobs();
+        for (int j = 0; j < background_job_count; j++) {
+            groups[j] = background_jobs[j].pid;
+        }
+        qsort(groups, (size_t)background_job_count, sizeof(pid_t), compare_pids);
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = n > 0 ? seconds_between(&monitor.last_refresh, &now) : 0;
+        monitor.last_refresh = now;
+        if (!update_samples(&monitor, groups, background_job_count, elapsed)) {
+            perror("activities");
+            status = 1;
+            break;
+        }
+
+        int max_rows = 0;
+        if (on_terminal) {
+            struct winsize size;
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) max_rows = size.ws_row - 1;
+            // Home the cursor and clear the screen.
+            printf("\033[H\033[J");
+        } else if (n > 0) {
+            printf("\n");
+        }
+        render(&monitor, interval, max_rows);
+        fflush(stdout);
+
+        if (refreshes != 0 && n + 1 >= refreshes) break;
+        if (wait_for_interrupt((long)(interval * 1000))) {
+            status = 130;
+            break;
+        }
+    }
+
+    for (int i = 0; i < monitor.samples.count; i++) {
+        close_sample(&monitor.samples.items[i]);
+    }
+    free(monitor.samples.items);
+    free(monitor.pids);
+    free(groups);
+    closedir(monitor.proc);
+    return status;
+}
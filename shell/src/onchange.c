@@ -0,0 +1,283 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/inotify.h>
+#include "../include/onchange.h"
+#include "../include/executor.h"
+#include "../include/pipeline.h"
+#include "../include/zygote.h"
+#include "../include/signals.h"
+#include "../include/jobs.h"
+
+extern bool is_interactive_mode;
+extern int last_exit_status;
+
+#define DEFAULT_DEBOUNCE_MS 100
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_DELETE_SELF | IN_MOVE_SELF)
+
+// onchange runs as a job of its own: this process watches, and each run is
+// a child of it in the same process group, so that Ctrl-C, Ctrl-Z, fg and
+// bg reach the run along with the watcher.
+typedef struct {
+    int wd;
+    char* path;
+} Watch;
+
+static int inotify_fd = -1;
+static Watch* watches = NULL;
+static int watch_count = 0;
+static int watch_capacity = 0;
+static bool recursive = false;
+
+static pid_t run_pid = -1;
+static volatile sig_atomic_t stop_signal = 0;
+
+static const char* watch_path(int wd) {
+    for (int i = 0; i < watch_count; i++) {
+        if (watches[i].wd == wd) return watches[i].path;
+    }
+    return NULL;
+}
+
+static void forget_watch(int wd) {
+    for (int i = 0; i < watch_count; i++) {
+        if (watches[i].wd != wd) continue;
+        free(watches[i].path);
+        watches[i] = watches[--watch_count];
+        return;
+    }
+}
+
+// Watches path, and with -r every directory below it. Only a failure on
+// path itself is reported.
+static bool add_watches(const char* path, bool report) {
+    int wd = inotify_add_watch(inotify_fd, path, WATCH_MASK);
+    if (wd == -1) {
+        if (report) fprintf(stderr, "onchange: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    // The same inode watched twice gets the same descriptor.
+    if (watch_path(wd) != NULL) return true;
+    if (watch_count == watch_capacity) {
+        int new_capacity = watch_capacity ? watch_capacity * 2 : 16;
+        Watch* grown = realloc(watches, (size_t)new_capacity * sizeof(Watch));
+        if (!grown) {
+            perror("onchange: realloc");
+            return false;
+        }
+        watches = grown;
+        watch_capacity = new_capacity;
+    }
+    char* copy = strdup(path);
+    if (!copy) return false;
+    watches[watch_count++] = (Watch){ wd, copy };
+
+    if (!recursive) return true;
+    DIR* dir = opendir(path);
+    if (!dir) return true;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char child[PATH_MAX];
+        int length = snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (length < 0 || (size_t)length >= sizeof(child)) continue;
+        struct stat st;
+        bool is_dir = entry->d_type == DT_DIR ||
+                      (entry->d_type == DT_UNKNOWN && lstat(child, &st) == 0 && S_ISDIR(st.st_mode));
+        if (is_dir) add_watches(child, false);
+    }
+    closedir(dir);
+    return true;
+}
+
+// Reads the queued events. Returns true if any of them is a change.
+static bool drain_events(void) {
+    union {
+        struct inotify_event event;
+        char bytes[8192];
+    } buffer;
+    bool changed = false;
+    for (;;) {
+        ssize_t n = read(inotify_fd, buffer.bytes, sizeof(buffer.bytes));
+        if (n <= 0) break;
+        for (char* p = buffer.bytes; p < buffer.bytes + n;) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_IGNORED) {
+                forget_watch(event->wd);
+                continue;
+            }
+            changed = true;
+            // New directories below a recursive watch are watched too.
+            const char* parent = watch_path(event->wd);
+            if (recursive && parent && event->len > 0 && (event->mask & IN_ISDIR) &&
+                (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                char child[PATH_MAX];
+                int length = snprintf(child, sizeof(child), "%s/%s", parent, event->name);
+                if (length > 0 && (size_t)length < sizeof(child)) add_watches(child, false);
+            }
+        }
+    }
+    return changed;
+}
+
+static long long now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void request_stop(int signo) {
+    stop_signal = signo;
+}
+
+// Ctrl-Z or `ping PID 20` on the watcher stops the run with it.
+static void stop_group(int signo) {
+    (void)signo;
+    kill(0, SIGSTOP);
+}
+
+// Only there to wake poll() when a run ends, so it is reaped straight away.
+static void note_child(int signo) {
+    (void)signo;
+}
+
+static void set_handler(int signo, void (*handler)(int)) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(signo, &sa, NULL);
+}
+
+// Ends the previous run if it is still going. It shares the watcher's
+// process group, so the watcher ignores its own SIGTERM meanwhile.
+static void cancel_run(void) {
+    if (run_pid <= 0) return;
+    if (waitpid(run_pid, NULL, WNOHANG) == 0) {
+        set_handler(SIGTERM, SIG_IGN);
+        kill(0, SIGTERM);
+        kill(0, SIGCONT);
+        waitpid(run_pid, NULL, 0);
+        set_handler(SIGTERM, request_stop);
+    }
+    run_pid = -1;
+}
+
+// The command's words were expanded once, when onchange itself ran, and go
+// to execute() as they are, so each keeps its quoting.
+static void start_run(char** command, int word_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    cancel_run();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return;
+    }
+    if (pid > 0) {
+        run_pid = pid;
+        return;
+    }
+
+    reset_child_signals();
+    close(inotify_fd);
+    // Nothing follows the command here, so it may take this process over.
+    pipeline_exec_in_place(true);
+    execute(command, word_count, prev_dir, SHELL_HOME_DIR);
+    fflush(stdout);
+    exit(last_exit_status);
+}
+
+static bool parse_debounce(const char* text, long* debounce_ms) {
+    char* end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || value < 0) return false;
+    *debounce_ms = value;
+    return true;
+}
+
+int onchange_command(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    long debounce_ms = DEFAULT_DEBOUNCE_MS;
+    int i = 1;
+    for (; i < token_count && tokens[i][0] == '-' && strcmp(tokens[i], "--") != 0; i++) {
+        if (strcmp(tokens[i], "-r") == 0) recursive = true;
+        else if (strcmp(tokens[i], "-d") == 0 && i + 1 < token_count && parse_debounce(tokens[i + 1], &debounce_ms)) i++;
+        else break;
+    }
+    int first_path = i;
+    while (i < token_count && strcmp(tokens[i], "--") != 0) i++;
+    if (first_path == i || i + 1 >= token_count) {
+        fprintf(stderr, "Syntax: onchange [-r] [-d ms] PATH... -- command [arg...]\n");
+        return 1;
+    }
+    int last_path = i;
+
+    char** command = &tokens[last_path + 1];
+    int word_count = token_count - last_path - 1;
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1) {
+        perror("inotify_init1");
+        return 1;
+    }
+    for (int j = first_path; j < last_path; j++) {
+        if (!add_watches(tokens[j], true)) return 1;
+    }
+
+    // As in a process substitution, the runs belong to this job.
+    is_interactive_mode = false;
+    background_job_count = 0;
+    zygote_pool_detach();
+    pipeline_stay_in_process_group();
+    set_handler(SIGINT, request_stop);
+    set_handler(SIGTERM, request_stop);
+    set_handler(SIGHUP, request_stop);
+    set_handler(SIGTSTP, stop_group);
+    set_handler(SIGCHLD, note_child);
+
+    // A change starts the debounce window, and every further change in it
+    // starts it again; the command runs once things have been quiet that
+    // long.
+    start_run(command, word_count, prev_dir, SHELL_HOME_DIR);
+    long long due = -1;
+    while (stop_signal == 0) {
+        int timeout = -1;
+        if (due != -1) {
+            long long left = due - now_ms();
+            timeout = left > 0 ? (int)left : 0;
+        }
+        struct pollfd pfd = { inotify_fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready == -1 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (ready > 0 && drain_events()) {
+            due = now_ms() + debounce_ms;
+        } else if (ready == 0 && due != -1) {
+            due = -1;
+            // A file watched by name may have been replaced by a rename.
+            for (int j = first_path; j < last_path; j++) add_watches(tokens[j], false);
+            start_run(command, word_count, prev_dir, SHELL_HOME_DIR);
+        }
+        // Reaps a run that has finished by itself.
+        if (run_pid > 0 && waitpid(run_pid, NULL, WNOHANG) == run_pid) run_pid = -1;
+    }
+
+    cancel_run();
+    exit(stop_signal ? 128 + stop_signal : 1);
+}
@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "../include/parallel.h"
+#include "../include/process.h"
+#include "../include/signals.h"
+#include "../include/placement.h"
+
+#define MAX_WORKERS 256
+// Unordered chunks match a pipe's capacity, so a busy worker never has much
+// more than one waiting; ordered ones start a process each, so are larger.
+#define UNORDERED_CHUNK (64 * 1024)
+#define ORDERED_CHUNK (1024 * 1024)
+#define READ_SIZE (64 * 1024)
+// A short chunk goes out once the input has paused this long.
+#define IDLE_FLUSH_MS 10
+#define SOURCE_FD 3
+#define SINK_FD 4
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+typedef struct {
+    pid_t pid;          // 0: slot free
+    int in_fd;          // -1 once closed
+    int out_fd;         // -1 at EOF
+    Buffer input;       // the chunk being written
+    size_t sent;
+    Buffer output;      // unordered: a partial line; ordered: held output
+    long sequence;      // ordered: the chunk's number
+} Worker;
+
+typedef struct {
+    Worker workers[2 * MAX_WORKERS];
+    // Unordered: the N long-lived workers. Ordered: chunks in flight, of
+    // which at most `running` are still producing output.
+    int slots;
+    int running;
+    bool ordered;
+    size_t chunk_size;
+    Buffer pending;     // input not yet handed out
+    bool input_eof;
+    long long last_input;
+    long next_sequence;
+    long next_emit;
+    int exit_code;
+    char** tokens;
+    int token_count;
+    char** prev_dir;
+    char* home;
+} Coordinator;
+
+bool parse_parallel_prefix(const char* token, int* workers, bool* ordered) {
+    if (token == NULL || token[0] != '[') return false;
+    char* end;
+    long count = strtol(token + 1, &end, 10);
+    if (end == token + 1 || count < 1) return false;
+    if (strcmp(end, "]") == 0) *ordered = false;
+    else if (strcmp(end, ":o]") == 0) *ordered = true;
+    else return false;
+    *workers = count > MAX_WORKERS ? MAX_WORKERS : (int)count;
+    return true;
+}
+
+static long long now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void buffer_reserve(Buffer* buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) return;
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra) capacity *= 2;
+    char* data = realloc(buffer->data, capacity);
+    if (!data) {
+        perror("realloc");
+        _exit(1);
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+}
+
+static void buffer_consume(Buffer* buffer, size_t length) {
+    memmove(buffer->data, buffer->data + length, buffer->length - length);
+    buffer->length -= length;
+}
+
+static void emit(const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(SINK_FD, data, length);
+        if (n == -1 && errno == EINTR) continue;
+        // Nothing reads the stage's output any more; the workers follow as
+        // soon as they write to us.
+        if (n == -1) _exit(errno == EPIPE ? 141 : 1);
+        data += n;
+        length -= (size_t)n;
+    }
+}
+
+// Length of the next chunk in pending, or 0 if none is ready. Chunks end on
+// a newline; a line longer than a chunk goes out whole.
+static size_t next_chunk_length(const Coordinator* c, long long now) {
+    const Buffer* pending = &c->pending;
+    if (pending->length == 0) return 0;
+    if (pending->length < c->chunk_size) {
+        if (c->input_eof) return pending->length;
+        if (now - c->last_input < IDLE_FLUSH_MS) return 0;
+    }
+    size_t take = pending->length < c->chunk_size ? pending->length : c->chunk_size;
+    const char* newline = memrchr(pending->data, '\n', take);
+    if (newline == NULL && pending->length > take) {
+        newline = memchr(pending->data + take, '\n', pending->length - take);
+    }
+    if (newline != NULL) return (size_t)(newline - pending->data) + 1;
+    return c->input_eof ? pending->length : 0;
+}
+
+static void take_chunk(Coordinator* c, Worker* worker, size_t length) {
+    worker->input.length = 0;
+    buffer_reserve(&worker->input, length);
+    memcpy(worker->input.data, c->pending.data, length);
+    worker->input.length = length;
+    worker->sent = 0;
+    buffer_consume(&c->pending, length);
+}
+
+static bool spawn_worker(Coordinator* c, Worker* worker) {
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return false;
+    }
+    if (pipe2(out, O_CLOEXEC) == -1) {
+        perror("pipe");
+        close(in[0]);
+        close(in[1]);
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        return false;
+    }
+    if (pid == 0) {
+        signal(SIGPIPE, SIG_DFL);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        // A builtin never execs, so drop the other workers' pipes by hand.
+        close_range(3, ~0U, 0);
+        run_command_in_child(c->tokens, c->token_count, false, c->prev_dir, c->home);
+    }
+    close(in[0]);
+    close(out[1]);
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    worker->pid = pid;
+    worker->in_fd = in[1];
+    worker->out_fd = out[0];
+    worker->input.length = worker->sent = 0;
+    worker->output.length = 0;
+    return true;
+}
+
+static void close_input(Worker* worker) {
+    if (worker->in_fd != -1) close(worker->in_fd);
+    worker->in_fd = -1;
+    worker->input.length = worker->sent = 0;
+}
+
+static void record_status(Coordinator* c, int status) {
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    if (c->exit_code == 0) c->exit_code = code;
+}
+
+// Hands out whatever chunks are ready: to idle workers when unordered, to
+// new workers when ordered.
+static void dispatch(Coordinator* c, long long now) {
+    for (int i = 0; i < c->slots; i++) {
+        Worker* worker = &c->workers[i];
+        if (c->ordered) {
+            if (worker->pid != 0 || c->running >= c->slots / 2) continue;
+        } else if (worker->in_fd == -1 || worker->sent < worker->input.length) {
+            continue;
+        }
+        size_t length = next_chunk_length(c, now);
+        if (length == 0) break;
+        if (c->ordered) {
+            if (!spawn_worker(c, worker)) _exit(1);
+            worker->sequence = c->next_sequence++;
+            c->running++;
+        }
+        take_chunk(c, worker, length);
+    }
+
+    if (c->input_eof && c->pending.length == 0) {
+        // All handed out: workers see EOF once their last chunk is written.
+        for (int i = 0; i < c->slots; i++) {
+            Worker* worker = &c->workers[i];
+            if (worker->in_fd != -1 && worker->sent == worker->input.length) close_input(worker);
+        }
+    }
+}
+
+static void write_input(Worker* worker, bool ordered) {
+    ssize_t n = write(worker->in_fd, worker->input.data + worker->sent, worker->input.length - worker->sent);
+    if (n > 0) worker->sent += (size_t)n;
+    // A worker that stops reading, like `head`, drops the rest of its chunk.
+    else if (n == -1 && errno != EAGAIN && errno != EINTR) close_input(worker);
+    if (ordered && worker->in_fd != -1 && worker->sent == worker->input.length) close_input(worker);
+}
+
+static Worker* find_sequence(Coordinator* c, long sequence) {
+    for (int i = 0; i < c->slots; i++) {
+        if (c->workers[i].pid != 0 && c->workers[i].sequence == sequence) return &c->workers[i];
+    }
+    return NULL;
+}
+
+// Writes out held output in chunk order, freeing the slots of finished
+// chunks.
+static void advance(Coordinator* c) {
+    Worker* head;
+    while ((head = find_sequence(c, c->next_emit)) != NULL) {
+        emit(head->output.data, head->output.length);
+        head->output.length = 0;
+        if (head->out_fd != -1) return;
+        head->pid = 0;
+        c->next_emit++;
+    }
+}
+
+static void read_output(Coordinator* c, Worker* worker) {
+    buffer_reserve(&worker->output, READ_SIZE);
+    ssize_t n = read(worker->out_fd, worker->output.data + worker->output.length, READ_SIZE);
+    if (n == -1 && errno == EINTR) return;
+    if (n > 0) worker->output.length += (size_t)n;
+
+    if (n <= 0) {
+        close(worker->out_fd);
+        worker->out_fd = -1;
+        if (c->ordered) {
+            c->running--;
+            advance(c);
+        } else {
+            // A last line without a newline still goes out whole.
+            emit(worker->output.data, worker->output.length);
+            worker->output.length = 0;
+        }
+    } else if (c->ordered) {
+        if (worker->sequence == c->next_emit) advance(c);
+    } else {
+        // Only whole lines, so that workers' lines never interleave.
+        const char* newline = memrchr(worker->output.data, '\n', worker->output.length);
+        if (newline != NULL) {
+            size_t length = (size_t)(newline - worker->output.data) + 1;
+            emit(worker->output.data, length);
+            buffer_consume(&worker->output, length);
+        }
+    }
+}
+
+static void run_coordinator(Coordinator* c) {
+    struct pollfd fds[1 + 4 * MAX_WORKERS];
+    Worker* owners[1 + 4 * MAX_WORKERS];
+    for (;;) {
+        int status;
+        while (waitpid(-1, &status, WNOHANG) > 0) record_status(c, status);
+
+        long long now = now_ms();
+        dispatch(c, now);
+
+        bool any_input = false, any_output = false;
+        for (int i = 0; i < c->slots; i++) {
+            if (c->workers[i].in_fd != -1) any_input = true;
+            if (c->workers[i].out_fd != -1) any_output = true;
+        }
+        if (!c->ordered && !any_input && !c->input_eof) {
+            // Every worker has quit reading; stop reading too.
+            c->input_eof = true;
+            c->pending.length = 0;
+        }
+        if (c->input_eof && c->pending.length == 0 && !any_input && !any_output) break;
+
+        int count = 0;
+        bool want_input = !c->input_eof &&
+            (c->pending.length < c->chunk_size || memchr(c->pending.data, '\n', c->pending.length) == NULL);
+        if (want_input) {
+            fds[count] = (struct pollfd){ SOURCE_FD, POLLIN, 0 };
+            owners[count++] = NULL;
+        }
+        for (int i = 0; i < c->slots; i++) {
+            Worker* worker = &c->workers[i];
+            if (worker->in_fd != -1 && worker->sent < worker->input.length) {
+                fds[count] = (struct pollfd){ worker->in_fd, POLLOUT, 0 };
+                owners[count++] = worker;
+            }
+            if (worker->out_fd != -1) {
+                fds[count] = (struct pollfd){ worker->out_fd, POLLIN, 0 };
+                owners[count++] = worker;
+            }
+        }
+        // Wake up to send a short chunk once the input pauses.
+        int timeout = -1;
+        if (!c->input_eof && c->pending.length > 0 && c->pending.length < c->chunk_size) {
+            long long wait = IDLE_FLUSH_MS - (now - c->last_input);
+            // Once past, dispatch() has already cut what it could.
+            if (wait > 0) timeout = (int)wait;
+        }
+        if (poll(fds, count, timeout) == -1) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            _exit(1);
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (fds[i].revents == 0) continue;
+            Worker* worker = owners[i];
+            if (worker == NULL) {
+                buffer_reserve(&c->pending, READ_SIZE);
+                ssize_t n = read(SOURCE_FD, c->pending.data + c->pending.length, READ_SIZE);
+                if (n == -1 && errno == EINTR) continue;
+                if (n <= 0) c->input_eof = true;
+                else c->pending.length += (size_t)n;
+                c->last_input = now_ms();
+            } else if (fds[i].events == POLLOUT) {
+                if (worker->in_fd != -1) write_input(worker, c->ordered);
+            } else if (worker->out_fd != -1) {
+                read_output(c, worker);
+            }
+        }
+    }
+
+    int status;
+    while (waitpid(-1, &status, 0) > 0) record_status(c, status);
+}
+
+pid_t start_parallel_stage(int in_fd, int out_fd, char** tokens, int token_count, int workers, bool ordered, pid_t* pgid, char** prev_dir, char* SHELL_HOME_DIR) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        reset_child_signals();
+        // Workers join the group, and take its placement, by inheriting
+        // them from here.
+        setpgid(0, *pgid);
+        placement_apply_in_child();
+        if (in_fd != -1) dup2(in_fd, STDIN_FILENO);
+        if (out_fd != -1) dup2(out_fd, STDOUT_FILENO);
+        // Redirections belong to the stage as a whole, not to each worker.
+        char** args = malloc((token_count + 1) * sizeof(char*));
+        int arg_count = 0;
+        if (!args || !apply_redirections(tokens, token_count, args, &arg_count, NULL)) _exit(1);
+        dup2(fcntl(STDIN_FILENO, F_DUPFD, 10), SOURCE_FD);
+        dup2(fcntl(STDOUT_FILENO, F_DUPFD, 10), SINK_FD);
+        close_range(SINK_FD + 1, ~0U, 0);
+        // A worker that exits early must not take the stage down with it.
+        signal(SIGPIPE, SIG_IGN);
+
+        static Coordinator c;
+        c.slots = ordered ? 2 * workers : workers;
+        c.running = 0;
+        c.ordered = ordered;
+        c.chunk_size = ordered ? ORDERED_CHUNK : UNORDERED_CHUNK;
+        c.last_input = now_ms();
+        c.tokens = args;
+        c.token_count = arg_count;
+        c.prev_dir = prev_dir;
+        c.home = SHELL_HOME_DIR;
+        for (int i = 0; i < c.slots; i++) {
+            c.workers[i].in_fd = c.workers[i].out_fd = -1;
+            if (!ordered && !spawn_worker(&c, &c.workers[i])) _exit(1);
+        }
+        run_coordinator(&c);
+        _exit(c.exit_code);
+    }
+    if (*pgid == 0) *pgid = pid;
+    setpgid(pid, *pgid);
+    return pid;
+}
@@ -5,9 +5,6 @@
 #include <stdio.h>
 #include "../include/parser.h"
 
-#define MAX_TOKENS 100
-#define MAX_TOKEN_LENGTH 256
-
 // Helper function to remove leading and trailing whitespace.
 void trim_whitespace(char* str) {
     if (str == NULL || *str == '\0') {
@@ -28,9 +25,15 @@ void trim_whitespace(char* str) {
     memmove(str, start, strlen(start) + 1);
 }
 
+bool is_process_substitution(const char* token) {
+    size_t length = strlen(token);
+    return length >= 3 && (token[0] == '<' || token[0] == '>') && token[1] == '(' && token[length - 1] == ')';
+}
+
 // Check if a token is a valid command name (not an operator).
 bool is_command_or_arg(const char* token) {
     if (token == NULL || strlen(token) == 0) return false;
+    if (is_process_substitution(token)) return true;
     return (strpbrk(token, "|&><;") == NULL);
 }
 
@@ -38,67 +41,107 @@ bool is_command_or_arg(const char* token) {
 bool is_valid_operator(const char* token) {
     return (strcmp(token, "|") == 0 || strcmp(token, ";") == 0 ||
             strcmp(token, "<") == 0 || strcmp(token, ">") == 0 ||
-            strcmp(token, ">>") == 0 || strcmp(token, "&") == 0);
+            strcmp(token, ">>") == 0 || strcmp(token, "&") == 0 ||
+            strcmp(token, "|>") == 0 || strcmp(token, "&!") == 0);
 }
 
 // A robust tokenizer that correctly separates operators and arguments by copying them.
-void tokenize_input(char* line, char* tokens[], int* token_count) {
-    *token_count = 0;
+void tokenize_input(char* line, ArgVector* tokens) {
     char* current = line;
 
-    while (*current != '\0' && *token_count < MAX_TOKENS) {
+    while (*current != '\0') {
         // Skip leading whitespace.
         while (*current == ' ' || *current == '\t' || *current == '\n' || *current == '\r') {
             current++;
         }
         if (*current == '\0') break;
 
-        char token_buffer[MAX_TOKEN_LENGTH];
-        int buffer_index = 0;
-        
+        // <(command) and >(command) are single words, through the matching ')'.
+        if ((*current == '<' || *current == '>') && current[1] == '(') {
+            char* token_start = current++;
+            int depth = 0;
+            do {
+                if (*current == '(') depth++;
+                else if (*current == ')') depth--;
+                current++;
+            } while (*current != '\0' && depth > 0);
+            arg_vector_push_copy(tokens, token_start, current - token_start);
+            continue;
+        }
+
         // Handle two-character operators first to prevent issues with single-character operators.
-        if (*current == '>' && current[1] == '>') {
-            tokens[(*token_count)++] = strdup(">>");
+        if ((*current == '>' && current[1] == '>') || (*current == '|' && current[1] == '>') ||
+            (*current == '&' && current[1] == '!')) {
+            arg_vector_push_copy(tokens, current, 2);
             current += 2;
             continue;
         }
 
         // Handle one-character operators.
         if (strchr("|&><;", *current) != NULL) {
-            token_buffer[buffer_index++] = *current;
-            token_buffer[buffer_index] = '\0';
-            tokens[(*token_count)++] = strdup(token_buffer);
+            arg_vector_push_copy(tokens, current, 1);
             current++;
             continue;
         }
         
-        // NEW: Handle quoted strings.
+        // NEW: Handle quoted strings, marked with QUOTED_WORD.
         if (*current == '"') {
             current++; // Move past the opening quote
             char* token_start = current;
             while (*current != '\0' && *current != '"') {
                 current++;
             }
-            int len = current - token_start;
-            strncpy(token_buffer, token_start, len);
-            token_buffer[len] = '\0';
-            tokens[(*token_count)++] = strdup(token_buffer);
+            size_t length = current - token_start;
+            char* word = malloc(length + 2);
+            if (word == NULL) {
+                perror("malloc");
+                continue;
+            }
+            word[0] = QUOTED_WORD;
+            memcpy(word + 1, token_start, length);
+            word[length + 1] = '\0';
+            if (!arg_vector_push(tokens, word, true)) free(word);
             if (*current == '"') {
                 current++; // Move past the closing quote
             }
             continue;
         }
 
-        // Otherwise, it's a word (command or arg).
+        // Otherwise, it's a word (command or arg). A quoted part inside it,
+        // as in NAME="a b", stays in the word without its quotes, with
+        // QUOTED_WORD where the first one began.
         char* token_start = current;
+        bool has_quotes = false;
         while (*current != '\0' && !strchr(" |&><;", *current) &&
                *current != '\t' && *current != '\n' && *current != '\r') {
+            if (*current == '"') {
+                has_quotes = true;
+                char* closing = strchr(current + 1, '"');
+                current = closing ? closing : current + strlen(current) - 1;
+            }
             current++;
         }
-        int len = current - token_start;
-        strncpy(token_buffer, token_start, len);
-        token_buffer[len] = '\0';
-        tokens[(*token_count)++] = strdup(token_buffer);
+        if (!has_quotes) {
+            arg_vector_push_copy(tokens, token_start, current - token_start);
+            continue;
+        }
+        char* word = malloc(current - token_start + 2);
+        if (word == NULL) {
+            perror("malloc");
+            continue;
+        }
+        size_t length = 0;
+        bool marked = false;
+        for (char* p = token_start; p < current; p++) {
+            if (*p != '"') {
+                word[length++] = *p;
+            } else if (!marked) {
+                word[length++] = QUOTED_WORD;
+                marked = true;
+            }
+        }
+        word[length] = '\0';
+        if (!arg_vector_push(tokens, word, true)) free(word);
     }
 }
 
@@ -124,35 +167,22 @@ bool validate_atomic_command(char* tokens[], int start_idx, int end_idx) {
                 return false;
             }
         }
+
+        // A fan-out names a file and may only be followed by another one.
+        if (strcmp(current_token, "|>") == 0) {
+            if (i + 1 > end_idx || !is_command_or_arg(tokens[i+1])) {
+                return false;
+            }
+            if (i + 2 <= end_idx && strcmp(tokens[i+2], "|>") != 0) {
+                return false;
+            }
+        }
     }
 
     return true;
 }
 
-bool parse_input(char* line) {
-    if (line == NULL) return false;
-
-    char* line_copy = strdup(line);
-    if (!line_copy) {
-        perror("strdup");
-        return false;
-    }
-
-    trim_whitespace(line_copy);
-    if (strlen(line_copy) == 0) {
-        free(line_copy);
-        return true;
-    }
-
-    char* tokens[MAX_TOKENS];
-    int token_count = 0;
-    tokenize_input(line_copy, tokens, &token_count);
-
-    if (token_count == 0) {
-        free(line_copy);
-        return true;
-    }
-
+static bool validate_tokens(char** tokens, int token_count) {
     int current_cmd_start = 0;
 
     for (int i = 0; i < token_count; i++) {
@@ -161,36 +191,31 @@ bool parse_input(char* line) {
         if (strcmp(current_token, "|") == 0) {
             // Validate the group before the pipe
             if (!validate_atomic_command(tokens, current_cmd_start, i - 1)) {
-                free(line_copy);
                 return false;
             }
             // Pipe cannot be at start or end or adjacent to another operator
             if (i + 1 >= token_count || is_valid_operator(tokens[i+1])) {
-                free(line_copy);
                 return false;
             }
             current_cmd_start = i + 1;
-        } else if (strcmp(current_token, ";") == 0 || strcmp(current_token, "&") == 0) {
+        } else if (strcmp(current_token, ";") == 0 || strcmp(current_token, "&") == 0 || strcmp(current_token, "&!") == 0) {
             // Validate the group before the separator
             if (!validate_atomic_command(tokens, current_cmd_start, i - 1)) {
-                free(line_copy);
                 return false;
             }
-            // Allow separator at end (e.g., trailing ';' or '&')
+            // Allow separator at end (e.g., trailing ';', '&' or '&!')
             if (i == token_count - 1) {
                 current_cmd_start = i + 1; // nothing follows
                 break;
             }
             // Next token must start a new command group (not operator or pipe)
             if (is_valid_operator(tokens[i+1]) || strcmp(tokens[i+1], "|") == 0) {
-                free(line_copy);
                 return false;
             }
             current_cmd_start = i + 1;
         } else {
             // Every token must be either a word or a valid operator
             if (!is_command_or_arg(current_token) && !is_valid_operator(current_token)) {
-                free(line_copy);
                 return false;
             }
         }
@@ -199,11 +224,24 @@ bool parse_input(char* line) {
     // Validate the final command group if any tokens remain after the last separator
     if (current_cmd_start < token_count) {
         if (!validate_atomic_command(tokens, current_cmd_start, token_count - 1)) {
-            free(line_copy);
             return false;
         }
     }
 
-    free(line_copy);
     return true;
+}
+
+bool parse_input(char* line) {
+    if (line == NULL) return false;
+
+    ArgVector tokens = ARG_VECTOR_INIT;
+    tokenize_input(line, &tokens);
+    // Quoting does not change what is valid.
+    for (int i = 0; i < tokens.count; i++) {
+        char* mark = strchr(tokens.items[i], QUOTED_WORD);
+        if (mark) memmove(mark, mark + 1, strlen(mark));
+    }
+    bool valid = validate_tokens(tokens.items, tokens.count);
+    arg_vector_free(&tokens);
+    return valid;
 }
\ No newline at end of file
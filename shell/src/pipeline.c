@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,63 +8,191 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <signal.h>
+#include <fcntl.h>
 #include "../include/pipeline.h"
 #include "../include/process.h"
 #include "../include/jobs.h"
 #include "../include/executor.h"
+#include "../include/signals.h"
+#include "../include/zygote.h"
+#include "../include/fanout.h"
+#include "../include/procsub.h"
+#include "../include/parser.h"
+#include "../include/timeout.h"
+#include "../include/parallel.h"
+#include "../include/jobout.h"
+#include "../include/placement.h"
 
 // External global variables
 extern pid_t foreground_pid;
 extern bool is_interactive_mode;
+extern int last_exit_status;
+
+// Cleared in a shell running a process substitution, whose commands belong
+// to the job it is part of.
+static bool own_process_groups = true;
+
+// Set by pipeline_exec_in_place() for the last command a non-interactive
+// shell runs.
+static bool exec_in_place = false;
 
 // This function is declared in executor.c but used here
-void execute_builtin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
+int execute_builtin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
 enum BuiltinType get_builtin_type(const char* cmd);
 
-pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, const char* command_name, char** prev_dir, char* SHELL_HOME_DIR) {
+// Classifies a command by its first word, skipping redirections and
+// NAME=value words.
+static enum BuiltinType command_builtin_type(char** tokens, int token_count) {
+    for (int i = 0; i < token_count; i++) {
+        if (strcmp(tokens[i], "<") == 0 || strcmp(tokens[i], ">") == 0 || strcmp(tokens[i], ">>") == 0) {
+            i++;
+        } else if (count_assignments(&tokens[i], 1) == 0) {
+            return get_command_builtin_type(&tokens[i], token_count - i);
+        }
+    }
+    return NOT_BUILTIN;
+}
+
+// Converts a waitpid() status into the shell's $? convention.
+static int exit_code_from_status(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status)) return 128 + WSTOPSIG(status);
+    return 0;
+}
+
+void pipeline_stay_in_process_group(void) {
+    own_process_groups = false;
+}
+
+void pipeline_exec_in_place(bool enable) {
+    exec_in_place = enable;
+}
+
+pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, bool capture_output, const char* command_name, char** prev_dir, char* SHELL_HOME_DIR) {
     if (token_count <= 0) return -1;
 
-    int pipe_count = 0;
+    // `timeout DURATION`, `pin CPUS`, `nice [N]` and `ionice CLASS` in front
+    // of a command or pipeline cover the whole job, in any order.
+    JobTimeout timeout;
+    JobPlacement placement;
+    memset(&timeout, 0, sizeof(timeout));
+    memset(&placement, 0, sizeof(placement));
+    for (;;) {
+        JobTimeout parsed;
+        int words = parse_timeout(tokens, token_count, &parsed);
+        if (words > 0) timeout = parsed;
+        else if (words == 0) words = parse_placement(tokens, token_count, &placement);
+        if (words < 0) {
+            last_exit_status = 125;
+            return 0;
+        }
+        if (words == 0) break;
+        tokens += words;
+        token_count -= words;
+        command_name = tokens[0];
+    }
+    bool placed = placement_is_set(&placement);
+    placement_begin_launch(&placement);
+
+    int pipe_count = 0, fanout_count = 0, substitution_count = 0, parallel_count = 0;
+    int workers;
+    bool ordered;
     for (int i = 0; i < token_count; i++) {
         if (strcmp(tokens[i], "|") == 0) pipe_count++;
+        else if (strcmp(tokens[i], "|>") == 0) fanout_count++;
+        else if (is_process_substitution(tokens[i])) substitution_count++;
+        else if ((i == 0 || strcmp(tokens[i - 1], "|") == 0) && parse_parallel_prefix(tokens[i], &workers, &ordered)) parallel_count++;
     }
 
-    if (pipe_count == 0) {
-        char* cmd_args[1024];
-        int arg_count = 0;
-        bool has_redirection = false;
-        for (int i = 0; i < token_count; i++) {
-            if (strcmp(tokens[i], "<") == 0 || strcmp(tokens[i], ">") == 0 || strcmp(tokens[i], ">>") == 0) {
-                has_redirection = true;
-                i++;
-            } else {
-                cmd_args[arg_count++] = tokens[i];
-            }
+    // A command with process substitutions takes the pipeline path, which
+    // gives it and the substituted commands one process group, as does a
+    // lone `[N] cmd`.
+    if (pipe_count == 0 && fanout_count == 0 && substitution_count == 0 && parallel_count == 0) {
+        // NAME=value words on their own set shell variables.
+        if (count_assignments(tokens, token_count) == token_count) {
+            for (int i = 0; i < token_count; i++) assign_variable(tokens[i]);
+            last_exit_status = 0;
+            return 0;
         }
-        cmd_args[arg_count] = NULL;
 
-        if (arg_count > 0 && get_builtin_type(cmd_args[0]) == SPECIAL_BUILTIN) {
-            if (has_redirection) {
-                fprintf(stderr, "shell: redirection is not supported for %s\n", cmd_args[0]);
+        // Builtins run inside the shell, with any redirection applied to the
+        // shell's own fds for the duration of the call. Only a regular
+        // builtin sent to the background, or given a timeout or placement,
+        // gets a process of its own, as a job builtin always does.
+        enum BuiltinType builtin_type = command_builtin_type(tokens, token_count);
+        bool in_shell = !run_in_background && timeout.deadline == 0 && !placed;
+        if (builtin_type == SPECIAL_BUILTIN || (builtin_type == REGULAR_BUILTIN && in_shell)) {
+            char** cmd_args = malloc((token_count + 1) * sizeof(char*));
+            int arg_count = 0;
+            SavedFds saved;
+            if (!cmd_args || !apply_redirections(tokens, token_count, cmd_args, &arg_count, &saved)) {
+                free(cmd_args);
+                last_exit_status = 1;
                 return 0;
             }
-            execute_builtin(cmd_args, arg_count, prev_dir, SHELL_HOME_DIR);
+            // Assignments in front of a builtin only reach external commands.
+            int assignments = count_assignments(cmd_args, arg_count);
+            char** command = cmd_args + assignments;
+            arg_count -= assignments;
+            last_exit_status = execute_builtin(command, arg_count, prev_dir, SHELL_HOME_DIR);
+            fflush(stdout);
+            // A bare `exec > file` redirects the shell itself from now on.
+            if (arg_count == 1 && strcmp(command[0], "exec") == 0) keep_redirections(&saved);
+            restore_redirections(&saved);
+            free(cmd_args);
             return 0;
         }
 
-        pid_t pid = fork();
-        if (pid == -1) { perror("fork"); return -1; }
-        if (pid == 0) {
-            if (is_interactive_mode) {
-                setpgid(0, 0);
-                if (!run_in_background) tcsetpgrp(STDIN_FILENO, getpgrp());
+        // Flush first so the child does not inherit (and repeat) buffered output.
+        fflush(stdout);
+
+        // Nothing is left for the shell to do once this command ends, so it
+        // becomes the command rather than forking it and waiting. Jobs and
+        // timeouts still need the shell around.
+        if (exec_in_place && !is_interactive_mode && !run_in_background && builtin_type == NOT_BUILTIN &&
+            timeout.deadline == 0 && background_job_count == 0) {
+            reset_child_signals();
+            placement_apply_in_child();
+            run_command_in_child(tokens, token_count, false, prev_dir, SHELL_HOME_DIR);
+        }
+        // `&!` sends stdout and stderr to a pipe the shell drains into a ring
+        // buffer. Zygotes only take over stdin and stdout, and were forked
+        // before any placement, so both cases fork.
+        int capture[2] = { -1, -1 };
+        if (capture_output && pipe2(capture, O_CLOEXEC) == -1) perror("pipe");
+        pid_t pid = -1;
+        pid_t group = own_process_groups ? 0 : getpgrp();
+        if (builtin_type == NOT_BUILTIN && capture[1] == -1 && !placed) {
+            pid = zygote_launch(tokens, token_count, run_in_background, group, -1, -1);
+        }
+        if (pid == -1) {
+            pid = fork();
+            if (pid == -1) { perror("fork"); return -1; }
+            if (pid == 0) {
+                reset_child_signals();
+                // Both sides set the group, so it is in place whichever runs
+                // first; the parent's call fails once the child has exec'd.
+                setpgid(0, group);
+                placement_apply_in_child();
+                if (is_interactive_mode && !run_in_background) claim_terminal();
+                if (capture[1] != -1) {
+                    dup2(capture[1], STDOUT_FILENO);
+                    dup2(capture[1], STDERR_FILENO);
+                }
+                run_command_in_child(tokens, token_count, run_in_background, prev_dir, SHELL_HOME_DIR);
             }
-            run_command_in_child(tokens, token_count, run_in_background, prev_dir, SHELL_HOME_DIR);
         }
 
-        setpgid(pid, pid);
+        setpgid(pid, group == 0 ? pid : group);
         if (run_in_background) {
             add_background_job(pid, command_name, RUNNING);
+            timeout_watch_job(pid, &timeout);
+            if (capture[1] != -1) {
+                close(capture[1]);
+                capture_job_output(pid, capture[0]);
+            }
+            last_exit_status = 0;
             return pid;
         }
         
@@ -71,10 +200,14 @@ pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, c
         if (is_interactive_mode) tcsetpgrp(STDIN_FILENO, pid);
         
         int status;
-        if (waitpid(pid, &status, WUNTRACED) != -1) {
+        if (timeout_waitpid(pid, &status, group == 0 ? pid : group, &timeout) != -1) {
+            last_exit_status = exit_code_from_status(status);
             if (WIFSTOPPED(status)) {
                 add_background_job(pid, command_name, STOPPED);
+                timeout_watch_job(pid, &timeout);
                 fprintf(stderr, "\n[%d] Stopped %s\n", find_most_recent_job()->job_number, command_name);
+            } else {
+                last_exit_status = timeout_exit_code(&timeout, last_exit_status);
             }
         }
         
@@ -85,8 +218,15 @@ pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, c
 
     // Pipeline execution
     int start = 0, num_cmds = pipe_count + 1;
-    pid_t pgid = 0, pids[num_cmds];
+    // Each `|> file` adds a helper process, plus one per stage for the drain,
+    // and each process substitution one more.
+    pid_t pgid = own_process_groups ? 0 : getpgrp();
+    pid_t pids[num_cmds + fanout_count + num_cmds + substitution_count], last_command_pid = -1;
     int pid_count = 0, fds[2], in_fd = -1;
+    fflush(stdout);
+    // The last stage's stdout and every stage's stderr, for `&!`.
+    int capture[2] = { -1, -1 };
+    if (capture_output && pipe2(capture, O_CLOEXEC) == -1) perror("pipe");
 
     for (int i = 0; i < num_cmds; i++) {
         int end = start;
@@ -95,24 +235,82 @@ pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, c
         bool is_last = (i == num_cmds - 1);
         if (!is_last && pipe(fds) == -1) { perror("pipe"); return -1; }
 
-        pid_t pid = fork();
-        if (pid == -1) { perror("fork"); return -1; }
-        if (pid == 0) { // Child
-            if (is_interactive_mode) {
-                setpgid(0, pgid == 0 ? 0 : pgid);
-                if (!run_in_background) tcsetpgrp(STDIN_FILENO, getpgrp());
+        char** child_tokens = &tokens[start];
+        int child_token_count = end - start;
+
+        // `cmd |> a |> b` sends the command's output through fan-out helpers
+        // on its way to the next stage.
+        int fanout_start = start;
+        while (fanout_start < end && strcmp(tokens[fanout_start], "|>") != 0) fanout_start++;
+        int fan[2] = { -1, -1 };
+        if (fanout_start < end) {
+            child_token_count = fanout_start - start;
+            if (pipe(fan) == -1) { perror("pipe"); return -1; }
+        }
+        int out_fd = fan[1] != -1 ? fan[1] : (is_last ? capture[1] : fds[1]);
+
+        // `[N] cmd` runs N copies of the stage behind a coordinator, which
+        // cannot pass them substitution pipes.
+        bool parallel = child_token_count > 1 && parse_parallel_prefix(child_tokens[0], &workers, &ordered);
+        if (parallel) {
+            child_tokens++;
+            child_token_count--;
+        }
+
+        ProcessSubstitutions subs;
+        if (parallel) memset(&subs, 0, sizeof(subs));
+        else if (!prepare_process_substitutions(child_tokens, child_token_count, &subs)) return -1;
+        if (subs.count > 0) {
+            child_tokens = subs.args.items;
+            child_token_count = subs.args.count;
+        }
+
+        pid_t pid = -1;
+        // Only external commands may go to a zygote, which holds a stale
+        // copy of shell state and could not receive the substitution pipes.
+        if (parallel) {
+            pid = start_parallel_stage(in_fd, out_fd, child_tokens, child_token_count, workers, ordered, &pgid, prev_dir, SHELL_HOME_DIR);
+            if (pid == -1) return -1;
+        } else if (subs.count == 0 && capture[1] == -1 && !placed && command_builtin_type(child_tokens, child_token_count) == NOT_BUILTIN) {
+            pid = zygote_launch(child_tokens, child_token_count, run_in_background, pgid, in_fd, out_fd);
+        }
+        if (pid == -1) {
+            pid = fork();
+            if (pid == -1) { perror("fork"); free_process_substitutions(&subs); return -1; }
+            if (pid == 0) { // Child
+                reset_child_signals();
+                setpgid(0, pgid);
+                placement_apply_in_child();
+                if (is_interactive_mode && !run_in_background) claim_terminal();
+                if (in_fd != -1) { dup2(in_fd, STDIN_FILENO); close(in_fd); }
+                if (out_fd != -1) dup2(out_fd, STDOUT_FILENO);
+                if (capture[1] != -1) dup2(capture[1], STDERR_FILENO);
+                if (fan[1] != -1) { close(fan[0]); close(fan[1]); }
+                if (!is_last) { close(fds[0]); close(fds[1]); }
+                keep_process_substitutions(&subs);
+
+                run_command_in_child(child_tokens, child_token_count, run_in_background, prev_dir, SHELL_HOME_DIR);
             }
-            if (in_fd != -1) { dup2(in_fd, STDIN_FILENO); close(in_fd); }
-            if (!is_last) { dup2(fds[1], STDOUT_FILENO); close(fds[0]); close(fds[1]); }
-            
-            char** child_tokens = &tokens[start];
-            int child_token_count = end - start;
-            run_command_in_child(child_tokens, child_token_count, run_in_background, prev_dir, SHELL_HOME_DIR);
         }
 
         if (pgid == 0) pgid = pid;
         setpgid(pid, pgid);
         pids[pid_count++] = pid;
+        last_command_pid = pid;
+        // Started after the command so that it leads the process group.
+        start_process_substitutions(&subs, &pgid, pids, &pid_count, prev_dir, SHELL_HOME_DIR);
+
+        if (fan[1] != -1) {
+            close(fan[1]);
+            char* paths[fanout_count];
+            int path_count = 0;
+            for (int t = fanout_start; t + 1 < end; t += 2) {
+                paths[path_count++] = tokens[t + 1];
+            }
+            int fan_out = is_last ? (capture[1] != -1 ? capture[1] : STDOUT_FILENO) : fds[1];
+            start_fanout(fan[0], paths, path_count, fan_out, &pgid, pids, &pid_count);
+            close(fan[0]);
+        }
 
         if (in_fd != -1) close(in_fd);
         if (!is_last) { close(fds[1]); in_fd = fds[0]; }
@@ -120,7 +318,15 @@ pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, c
     }
 
     if (run_in_background) {
-        if (pgid != 0) add_background_job(pgid, command_name, RUNNING);
+        if (capture[1] != -1) close(capture[1]);
+        if (pgid != 0) {
+            add_background_job(pgid, command_name, RUNNING);
+            timeout_watch_job(pgid, &timeout);
+            if (capture[0] != -1) capture_job_output(pgid, capture[0]);
+        } else if (capture[0] != -1) {
+            close(capture[0]);
+        }
+        last_exit_status = 0;
         return pgid;
     }
     
@@ -131,12 +337,15 @@ pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, c
     bool stopped = false;
     int processes_to_wait_for = pid_count;
     while (processes_to_wait_for > 0) {
-        pid_t child_pid = waitpid(-pgid, &status, WUNTRACED);
+        pid_t child_pid = timeout_waitpid(-pgid, &status, pgid, &timeout);
         if (child_pid > 0) {
             if (WIFSTOPPED(status)) {
+                last_exit_status = exit_code_from_status(status);
                 stopped = true;
                 break;
             } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                // A pipeline's status is that of its last command.
+                if (child_pid == last_command_pid) last_exit_status = exit_code_from_status(status);
                 processes_to_wait_for--;
             }
         } else if (errno == ECHILD) {
@@ -146,7 +355,10 @@ pid_t execute_pipeline(char** tokens, int token_count, bool run_in_background, c
 
     if (stopped) {
         add_background_job(pgid, command_name, STOPPED);
+        timeout_watch_job(pgid, &timeout);
         fprintf(stderr, "\n[%d] Stopped %s\n", find_most_recent_job()->job_number, command_name);
+    } else {
+        last_exit_status = timeout_exit_code(&timeout, last_exit_status);
     }
     
     if (is_interactive_mode) tcsetpgrp(STDIN_FILENO, getpgrp());
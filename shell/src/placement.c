@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "../include/placement.h"
+#include "../include/jobs.h"
+
+// From linux/ioprio.h, which glibc does not wrap.
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_VALUE(class, level) (((class) << IOPRIO_CLASS_SHIFT) | (level))
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+// Copied by placement_begin_launch(); forked children inherit it.
+static JobPlacement launching;
+
+static bool parse_int(const char* text, long low, long high, long* value) {
+    char* end;
+    errno = 0;
+    long n = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || n < low || n > high) return false;
+    *value = n;
+    return true;
+}
+
+// "4-7", "0,2,5-6".
+static bool parse_cpu_list(const char* text, JobPlacement* placement) {
+    memset(placement->cpus, 0, sizeof(placement->cpus));
+    const char* p = text;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) return false;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) return false;
+        }
+        if (last < first || last >= PLACEMENT_MAX_CPUS) return false;
+        for (long cpu = first; cpu <= last; cpu++) {
+            placement->cpus[cpu / BITS_PER_WORD] |= 1UL << (cpu % BITS_PER_WORD);
+        }
+        if (*end == ',' && end[1] != '\0') end++;
+        else if (*end != '\0') return false;
+        p = end;
+    }
+    placement->pinned = p != text;
+    return placement->pinned;
+}
+
+// "idle", "be", "best-effort", "rt", "realtime" or 1-3, with an optional
+// ":LEVEL" from 0 (highest) to 7.
+static bool parse_io_class(const char* text, int* ioprio) {
+    const char* colon = strchr(text, ':');
+    size_t length = colon ? (size_t)(colon - text) : strlen(text);
+    long level = 4;
+    if (colon && !parse_int(colon + 1, 0, 7, &level)) return false;
+
+    int class = 0;
+    if ((length == 2 && strncmp(text, "rt", 2) == 0) || (length == 8 && strncmp(text, "realtime", 8) == 0) ||
+        (length == 1 && text[0] == '1')) {
+        class = IOPRIO_CLASS_RT;
+    } else if ((length == 2 && strncmp(text, "be", 2) == 0) || (length == 11 && strncmp(text, "best-effort", 11) == 0) ||
+               (length == 1 && text[0] == '2')) {
+        class = IOPRIO_CLASS_BE;
+    } else if ((length == 4 && strncmp(text, "idle", 4) == 0) || (length == 1 && text[0] == '3')) {
+        class = IOPRIO_CLASS_IDLE;
+        level = 0;
+    } else {
+        return false;
+    }
+    *ioprio = IOPRIO_VALUE(class, (int)level);
+    return true;
+}
+
+// Anything that is not a complete prefix followed by a command, such as a
+// bare `nice` or `nice --adjustment=5 cmd`, is left to the external command
+// of that name, and placement is not touched.
+int parse_placement(char** tokens, int token_count, JobPlacement* placement) {
+    if (token_count == 0) return 0;
+    JobPlacement parsed = *placement;
+    int words = 0;
+    long value;
+    if (strcmp(tokens[0], "pin") == 0) {
+        if (token_count > 1 && parse_cpu_list(tokens[1], &parsed)) words = 2;
+    } else if (strcmp(tokens[0], "nice") == 0) {
+        // As nice(1): "nice N", "nice -n N", or 10 by default.
+        parsed.niced = true;
+        parsed.nice = 10;
+        words = 1;
+        if (token_count > 2 && strcmp(tokens[1], "-n") == 0) {
+            words = parse_int(tokens[2], -20, 19, &value) ? 3 : 0;
+        } else if (token_count > 1 && parse_int(tokens[1], -20, 19, &value)) {
+            words = 2;
+        } else if (token_count > 1 && tokens[1][0] == '-') {
+            words = 0;
+        }
+        if (words > 1) parsed.nice = (int)value;
+    } else if (strcmp(tokens[0], "ionice") == 0) {
+        if (token_count > 1 && parse_io_class(tokens[1], &parsed.ioprio)) words = 2;
+    }
+
+    if (words == 0 || words >= token_count) return 0;
+    *placement = parsed;
+    return words;
+}
+
+bool placement_is_set(const JobPlacement* placement) {
+    return placement->pinned || placement->niced || placement->ioprio != 0;
+}
+
+static void to_cpu_set(const JobPlacement* placement, cpu_set_t* set) {
+    CPU_ZERO(set);
+    for (int cpu = 0; cpu < PLACEMENT_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+        if (placement->cpus[cpu / BITS_PER_WORD] & (1UL << (cpu % BITS_PER_WORD))) CPU_SET(cpu, set);
+    }
+}
+
+static bool set_cpus(pid_t tid, const JobPlacement* placement) {
+    cpu_set_t set;
+    to_cpu_set(placement, &set);
+    return sched_setaffinity(tid, sizeof(set), &set) == 0;
+}
+
+static bool set_nice(pid_t tid, const JobPlacement* placement) {
+    return setpriority(PRIO_PROCESS, (id_t)tid, placement->nice) == 0;
+}
+
+static bool set_ioprio(pid_t tid, const JobPlacement* placement) {
+    return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, (int)tid, placement->ioprio) == 0;
+}
+
+void placement_begin_launch(const JobPlacement* placement) {
+    launching = *placement;
+}
+
+void placement_apply_in_child(void) {
+    const char* failed = NULL;
+    if (launching.pinned && !set_cpus(0, &launching)) failed = "pin";
+    else if (launching.niced && !set_nice(0, &launching)) failed = "nice";
+    else if (launching.ioprio != 0 && !set_ioprio(0, &launching)) failed = "ionice";
+    if (failed) {
+        perror(failed);
+        _exit(125);
+    }
+    // Its own children are placed by inheritance.
+    memset(&launching, 0, sizeof(launching));
+}
+
+// Reads the process group out of /proc/<pid>/stat, after the command name,
+// which may contain spaces and parentheses.
+static pid_t read_pgid(int proc_fd, pid_t pid) {
+    char path[64], buffer[512];
+    snprintf(path, sizeof(path), "%d/stat", (int)pid);
+    int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    buffer[n > 0 ? n : 0] = '\0';
+    char* close_paren = strrchr(buffer, ')');
+    int pgid;
+    if (!close_paren || sscanf(close_paren + 2, "%*c %*d %d", &pgid) != 1) return -1;
+    return (pid_t)pgid;
+}
+
+// Runs action on every thread of every process in group pgid. Returns the
+// number of threads changed, or -1 with errno set by the first failure.
+static int for_each_group_thread(pid_t pgid, bool (*action)(pid_t, const JobPlacement*), const JobPlacement* placement) {
+    DIR* proc = opendir("/proc");
+    if (!proc) return -1;
+    int changed = 0, error = 0;
+    struct dirent* entry;
+    while ((entry = readdir(proc)) != NULL) {
+        if (!isdigit((unsigned char)entry->d_name[0])) continue;
+        pid_t pid = (pid_t)atoi(entry->d_name);
+        if (read_pgid(dirfd(proc), pid) != pgid) continue;
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+        DIR* tasks = opendir(path);
+        if (!tasks) continue;
+        struct dirent* task;
+        while ((task = readdir(tasks)) != NULL) {
+            if (!isdigit((unsigned char)task->d_name[0])) continue;
+            if (action((pid_t)atoi(task->d_name), placement)) changed++;
+            // A thread that exits meanwhile is not an error.
+            else if (errno != ESRCH && error == 0) error = errno;
+        }
+        closedir(tasks);
+    }
+    closedir(proc);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return changed;
+}
+
+// Shared by the three builtins, "NAME VALUE [job_number]".
+static int retarget_job(char** tokens, int token_count, bool (*action)(pid_t, const JobPlacement*),
+                        const JobPlacement* placement) {
+    BackgroundJob* job = token_count == 3 ? find_job_by_number(atoi(tokens[2])) : find_most_recent_job();
+    if (job == NULL) {
+        fprintf(stderr, "No such job\n");
+        return 1;
+    }
+    int changed = for_each_group_thread(job->pid, action, placement);
+    if (changed <= 0) {
+        if (changed == 0) errno = ESRCH;
+        fprintf(stderr, "%s: [%d] %s: %s\n", tokens[0], job->job_number, job->command_name, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+int repin_command(char** tokens, int token_count) {
+    JobPlacement placement;
+    memset(&placement, 0, sizeof(placement));
+    if (token_count < 2 || token_count > 3 || !parse_cpu_list(tokens[1], &placement)) {
+        fprintf(stderr, "Syntax: repin CPUS [job_number]\n");
+        return 1;
+    }
+    return retarget_job(tokens, token_count, set_cpus, &placement);
+}
+
+int renice_command(char** tokens, int token_count) {
+    JobPlacement placement;
+    memset(&placement, 0, sizeof(placement));
+    long value;
+    if (token_count < 2 || token_count > 3 || !parse_int(tokens[1], -20, 19, &value)) {
+        fprintf(stderr, "Syntax: renice N [job_number]\n");
+        return 1;
+    }
+    placement.nice = (int)value;
+    return retarget_job(tokens, token_count, set_nice, &placement);
+}
+
+int reionice_command(char** tokens, int token_count) {
+    JobPlacement placement;
+    memset(&placement, 0, sizeof(placement));
+    if (token_count < 2 || token_count > 3 || !parse_io_class(tokens[1], &placement.ioprio)) {
+        fprintf(stderr, "Syntax: reionice CLASS[:LEVEL] [job_number]\n");
+        return 1;
+    }
+    return retarget_job(tokens, token_count, set_ioprio, &placement);
+}
+
+void format_cpus(pid_t tid, char* buffer, size_t size) {
+    cpu_set_t set;
+    snprintf(buffer, size, "-");
+    if (sched_getaffinity(tid, sizeof(set), &set) != 0) return;
+    if (CPU_COUNT(&set) >= sysconf(_SC_NPROCESSORS_ONLN)) {
+        snprintf(buffer, size, "all");
+        return;
+    }
+    size_t used = 0;
+    buffer[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set)) last++;
+        int n = last > cpu ? snprintf(buffer + used, size - used, "%s%d-%d", used ? "," : "", cpu, last)
+                           : snprintf(buffer + used, size - used, "%s%d", used ? "," : "", cpu);
+        if (n < 0 || (size_t)n >= size - used) {
+            // Too long for the column.
+            if (size > 4) snprintf(buffer + size - 4, 4, "...");
+            return;
+        }
+        used += (size_t)n;
+        cpu = last;
+    }
+}
+
+void format_ioprio(pid_t tid, char* buffer, size_t size) {
+    long ioprio = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, (int)tid);
+    int class = ioprio > 0 ? (int)(ioprio >> IOPRIO_CLASS_SHIFT) : 0;
+    int level = ioprio > 0 ? (int)(ioprio & ((1 << IOPRIO_CLASS_SHIFT) - 1)) : 0;
+    if (class == IOPRIO_CLASS_RT) snprintf(buffer, size, "rt/%d", level);
+    else if (class == IOPRIO_CLASS_BE) snprintf(buffer, size, "be/%d", level);
+    else if (class == IOPRIO_CLASS_IDLE) snprintf(buffer, size, "idle");
+    else snprintf(buffer, size, "-");
+}
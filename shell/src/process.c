@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,49 +15,223 @@
 #include "../include/fg_bg.h"
 #include "../include/signals.h"
 
+extern bool is_interactive_mode;
+
 // This function is declared in executor.c but used here
-void execute_builtin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
+int execute_builtin(char** tokens, int token_count, char** prev_dir, char* SHELL_HOME_DIR);
 enum BuiltinType get_builtin_type(const char* cmd);
 
-void run_command_in_child(char** tokens, int token_count, bool run_in_background, char** prev_dir, char* SHELL_HOME_DIR) {
-    char* cmd_args[1024];
-    int arg_count = 0;
+// Opens the file for one redirection operator, replacing any earlier one for
+// the same fd. Prints the same messages a forked command used to.
+static bool open_redirection(const char* op, const char* path, int* in_fd, int* out_fd) {
+    if (path == NULL) {
+        fprintf(stderr, "Syntax error near `%s`\n", op);
+        return false;
+    }
+    if (strcmp(op, "<") == 0) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) { printf("No such file or directory\n"); return false; }
+        if (*in_fd != -1) close(*in_fd);
+        *in_fd = fd;
+    } else {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (strcmp(op, ">>") == 0 ? O_APPEND : O_TRUNC);
+        int fd = open(path, flags, 0666);
+        if (fd == -1) { printf("Unable to create file for writing\n"); return false; }
+        if (*out_fd != -1) close(*out_fd);
+        *out_fd = fd;
+    }
+    return true;
+}
+
+// Moves fd onto target. With save, the old target is first kept on a
+// close-on-exec descriptor so it can be put back.
+static void replace_fd(int fd, int target, int* save) {
+    if (save != NULL) {
+        *save = fcntl(target, F_DUPFD_CLOEXEC, 10);
+    }
+    dup2(fd, target);
+    close(fd);
+}
+
+bool apply_redirections(char** tokens, int token_count, char** args, int* arg_count, SavedFds* saved) {
     int in_fd = -1, out_fd = -1;
+    *arg_count = 0;
+    if (saved != NULL) {
+        saved->saved_stdin = saved->saved_stdout = -1;
+    }
 
     for (int i = 0; i < token_count && tokens[i] != NULL; i++) {
-        if (strcmp(tokens[i], "<") == 0) {
-            if (!tokens[++i]) { fprintf(stderr, "Syntax error near `<`\n"); exit(1); }
-            if ((in_fd = open(tokens[i], O_RDONLY)) == -1) { printf("No such file or directory\n"); exit(1); }
-        } else if (strcmp(tokens[i], ">") == 0) {
-            if (!tokens[++i]) { fprintf(stderr, "Syntax error near `>`\n"); exit(1); }
-            if ((out_fd = open(tokens[i], O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) { printf("Unable to create file for writing\n"); exit(1); }
-        } else if (strcmp(tokens[i], ">>") == 0) {
-            if (!tokens[++i]) { fprintf(stderr, "Syntax error near `>>`\n"); exit(1); }
-            if ((out_fd = open(tokens[i], O_WRONLY | O_CREAT | O_APPEND, 0666)) == -1) { printf("Unable to create file for writing\n"); exit(1); }
+        if (strcmp(tokens[i], "<") == 0 || strcmp(tokens[i], ">") == 0 || strcmp(tokens[i], ">>") == 0) {
+            const char* op = tokens[i];
+            if (!open_redirection(op, tokens[++i], &in_fd, &out_fd)) {
+                if (in_fd != -1) close(in_fd);
+                if (out_fd != -1) close(out_fd);
+                return false;
+            }
+            if (tokens[i] == NULL) break;
         } else {
-            cmd_args[arg_count++] = tokens[i];
+            args[(*arg_count)++] = tokens[i];
         }
     }
-    cmd_args[arg_count] = NULL;
+    args[*arg_count] = NULL;
+
+    if (in_fd != -1) {
+        replace_fd(in_fd, STDIN_FILENO, saved ? &saved->saved_stdin : NULL);
+    }
+    if (out_fd != -1) {
+        // Output already buffered belongs to the old stdout.
+        fflush(stdout);
+        replace_fd(out_fd, STDOUT_FILENO, saved ? &saved->saved_stdout : NULL);
+    }
+    return true;
+}
+
+void restore_redirections(SavedFds* saved) {
+    if (saved->saved_stdout != -1) {
+        fflush(stdout);
+        dup2(saved->saved_stdout, STDOUT_FILENO);
+        close(saved->saved_stdout);
+        saved->saved_stdout = -1;
+    }
+    if (saved->saved_stdin != -1) {
+        dup2(saved->saved_stdin, STDIN_FILENO);
+        close(saved->saved_stdin);
+        clearerr(stdin);
+        saved->saved_stdin = -1;
+    }
+}
+
+void keep_redirections(SavedFds* saved) {
+    if (saved->saved_stdout != -1) close(saved->saved_stdout);
+    if (saved->saved_stdin != -1) close(saved->saved_stdin);
+    saved->saved_stdin = saved->saved_stdout = -1;
+}
+
+// Whether execvp() would find name, so that a typo does not cost the shell
+// its signal handling.
+static bool is_executable(const char* name) {
+    if (strchr(name, '/') != NULL) return access(name, X_OK) == 0;
+    const char* path = getenv("PATH");
+    if (path == NULL) path = "/bin:/usr/bin";
+    char candidate[4096];
+    while (*path) {
+        size_t length = strcspn(path, ":");
+        snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)length, length ? path : ".", name);
+        if (access(candidate, X_OK) == 0) return true;
+        path += length + (path[length] == ':');
+    }
+    return false;
+}
+
+int exec_command(char** args, int arg_count) {
+    // Only redirections: the caller keeps them in place.
+    if (arg_count < 2) return 0;
+    if (!is_executable(args[1])) {
+        fprintf(stderr, "exec: %s: Command not found!\n", args[1]);
+        if (!is_interactive_mode) exit(127);
+        return 127;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    // The new program gets the signal state of a forked command.
+    reset_child_signals();
+    execvp(args[1], &args[1]);
+    perror("exec");
+    exit(126);
+}
+
+static bool is_name_char(char c, bool first) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (!first && c >= '0' && c <= '9');
+}
+
+static bool is_assignment(const char* word) {
+    if (!is_name_char(word[0], true)) return false;
+    const char* p = word + 1;
+    while (is_name_char(*p, false)) p++;
+    return *p == '=';
+}
+
+int count_assignments(char** words, int word_count) {
+    int count = 0;
+    while (count < word_count && is_assignment(words[count])) count++;
+    return count;
+}
+
+void assign_variable(const char* assignment) {
+    const char* equals = strchr(assignment, '=');
+    char name[256];
+    size_t length = (size_t)(equals - assignment);
+    if (length >= sizeof(name)) length = sizeof(name) - 1;
+    memcpy(name, assignment, length);
+    name[length] = '\0';
+    if (setenv(name, equals + 1, 1) != 0) perror("setenv");
+}
+
+// Only the pointer array is new: unchanged entries still point at the
+// strings in environ, and the others at the assignment words themselves.
+static char** overlay_environment(char** assignments, int count) {
+    int env_count = 0;
+    while (environ[env_count] != NULL) env_count++;
+    char** envp = malloc((size_t)(env_count + count + 1) * sizeof(char*));
+    if (envp == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(envp, environ, (size_t)env_count * sizeof(char*));
+    int total = env_count;
+    for (int i = 0; i < count; i++) {
+        // The name with its '=', so that FOO does not match FOOBAR.
+        size_t prefix = (size_t)(strchr(assignments[i], '=') - assignments[i]) + 1;
+        int j = 0;
+        while (j < total && strncmp(envp[j], assignments[i], prefix) != 0) j++;
+        envp[j] = assignments[i];
+        if (j == total) total++;
+    }
+    envp[total] = NULL;
+    return envp;
+}
+
+void run_command_in_child(char** tokens, int token_count, bool run_in_background, char** prev_dir, char* SHELL_HOME_DIR) {
+    char** cmd_args = malloc((token_count + 1) * sizeof(char*));
+    int arg_count = 0;
+    if (!cmd_args) {
+        perror("malloc");
+        exit(1);
+    }
+    bool has_input_redirection = false;
+    for (int i = 0; i < token_count && tokens[i] != NULL; i++) {
+        if (strcmp(tokens[i], "<") == 0) has_input_redirection = true;
+    }
 
-    if (in_fd != -1) { dup2(in_fd, STDIN_FILENO); close(in_fd); }
-    if (out_fd != -1) { dup2(out_fd, STDOUT_FILENO); close(out_fd); }
-    if (run_in_background && in_fd == -1) {
+    if (!apply_redirections(tokens, token_count, cmd_args, &arg_count, NULL)) {
+        exit(1);
+    }
+
+    if (run_in_background && !has_input_redirection) {
         int devnull = open("/dev/null", O_RDONLY);
         if (devnull != -1) { dup2(devnull, STDIN_FILENO); close(devnull); }
     }
 
-    if (arg_count > 0 && get_builtin_type(cmd_args[0]) != NOT_BUILTIN) {
-        if (strcmp(cmd_args[0], "fg") == 0 || strcmp(cmd_args[0], "bg") == 0) {
-            fprintf(stderr, "%s: no job control\n", cmd_args[0]);
+    // NAME=value words in front of the command go into its environment
+    // only; builtins do not see them.
+    int assignments = count_assignments(cmd_args, arg_count);
+    char** command = cmd_args + assignments;
+    arg_count -= assignments;
+    if (assignments > 0 && arg_count == 0) exit(0);
+
+    if (arg_count > 0 && get_command_builtin_type(command, arg_count) != NOT_BUILTIN) {
+        if (strcmp(command[0], "fg") == 0 || strcmp(command[0], "bg") == 0) {
+            fprintf(stderr, "%s: no job control\n", command[0]);
             exit(1);
         }
-        execute_builtin(cmd_args, arg_count, prev_dir, SHELL_HOME_DIR);
-        exit(0);
+        exit(execute_builtin(command, arg_count, prev_dir, SHELL_HOME_DIR));
     }
     
     if (arg_count > 0) {
-        execvp(cmd_args[0], cmd_args);
+        // Swapping the table in the child, rather than passing it to
+        // execvpe(), also makes a PATH=... assignment steer the search.
+        if (assignments > 0) environ = overlay_environment(cmd_args, assignments);
+        execvp(command[0], command);
         fprintf(stderr, "Command not found!\n");
     }
     exit(127);
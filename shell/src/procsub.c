@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include "../include/procsub.h"
+#include "../include/parser.h"
+#include "../include/ast.h"
+#include "../include/pipeline.h"
+#include "../include/zygote.h"
+#include "../include/signals.h"
+#include "../include/placement.h"
+#include "../include/jobs.h"
+
+extern bool is_interactive_mode;
+extern int last_exit_status;
+
+static void close_pipes(ProcessSubstitutions* subs) {
+    for (int i = 0; i < subs->count; i++) {
+        if (subs->outer_fds[i] != -1) close(subs->outer_fds[i]);
+        if (subs->inner_fds[i] != -1) close(subs->inner_fds[i]);
+        free(subs->commands[i]);
+    }
+}
+
+void free_process_substitutions(ProcessSubstitutions* subs) {
+    close_pipes(subs);
+    arg_vector_free(&subs->args);
+    free(subs->outer_fds);
+    free(subs->inner_fds);
+    free(subs->commands);
+    free(subs->writes);
+    subs->count = 0;
+}
+
+bool prepare_process_substitutions(char** tokens, int token_count, ProcessSubstitutions* subs) {
+    memset(subs, 0, sizeof(*subs));
+    int wanted = 0;
+    for (int i = 0; i < token_count; i++) {
+        if (is_process_substitution(tokens[i])) wanted++;
+    }
+    if (wanted == 0) return true;
+
+    subs->outer_fds = malloc(wanted * sizeof(int));
+    subs->inner_fds = malloc(wanted * sizeof(int));
+    subs->commands = malloc(wanted * sizeof(char*));
+    subs->writes = malloc(wanted * sizeof(bool));
+    if (!subs->outer_fds || !subs->inner_fds || !subs->commands || !subs->writes) {
+        perror("malloc");
+        free_process_substitutions(subs);
+        return false;
+    }
+
+    for (int i = 0; i < token_count; i++) {
+        if (!is_process_substitution(tokens[i])) {
+            arg_vector_push(&subs->args, tokens[i], false);
+            continue;
+        }
+        // Close-on-exec, so no other command of the line inherits them.
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            perror("pipe");
+            free_process_substitutions(subs);
+            return false;
+        }
+        bool writes = (tokens[i][0] == '<');
+        int n = subs->count++;
+        subs->writes[n] = writes;
+        subs->outer_fds[n] = writes ? fds[0] : fds[1];
+        subs->inner_fds[n] = writes ? fds[1] : fds[0];
+        // Strip the "<(" and ")".
+        subs->commands[n] = strndup(tokens[i] + 2, strlen(tokens[i]) - 3);
+
+        char path[32];
+        int length = snprintf(path, sizeof(path), "/dev/fd/%d", subs->outer_fds[n]);
+        arg_vector_push_copy(&subs->args, path, (size_t)length);
+    }
+    return true;
+}
+
+void keep_process_substitutions(ProcessSubstitutions* subs) {
+    for (int i = 0; i < subs->count; i++) {
+        fcntl(subs->outer_fds[i], F_SETFD, 0);
+        // A builtin run here never execs, so its copy of the other end would
+        // keep the substituted command from seeing EOF.
+        close(subs->inner_fds[i]);
+    }
+}
+
+// Runs in the child: the substitution's command line, with the pipe as
+// stdout for <(cmd) or stdin for >(cmd).
+static void run_substitution(const char* command, int fd, bool writes, char** prev_dir, char* SHELL_HOME_DIR) {
+    is_interactive_mode = false;
+    // The jobs and zygotes are the parent shell's; `exit` here must not
+    // kill them.
+    background_job_count = 0;
+    zygote_pool_detach();
+    pipeline_stay_in_process_group();
+    dup2(fd, writes ? STDOUT_FILENO : STDIN_FILENO);
+    close_range(3, ~0U, 0);
+
+    char* line = strdup(command);
+    if (!line || !parse_input(line)) {
+        fprintf(stderr, "Invalid Syntax!\n");
+        free(line);
+        exit(2);
+    }
+    ArgVector tokens = ARG_VECTOR_INIT;
+    tokenize_input(line, &tokens);
+    free(line);
+    run_last_tokens(tokens.items, tokens.count, prev_dir, SHELL_HOME_DIR);
+    if (command_pending()) {
+        fprintf(stderr, "Invalid Syntax!\n");
+        exit(2);
+    }
+    fflush(stdout);
+    exit(last_exit_status);
+}
+
+bool start_process_substitutions(ProcessSubstitutions* subs, pid_t* pgid, pid_t* pids, int* pid_count, char** prev_dir, char* SHELL_HOME_DIR) {
+    bool ok = true;
+    fflush(stdout);
+    for (int i = 0; i < subs->count; i++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            ok = false;
+            break;
+        }
+        if (pid == 0) {
+            reset_child_signals();
+            setpgid(0, *pgid);
+            placement_apply_in_child();
+            run_substitution(subs->commands[i], subs->inner_fds[i], subs->writes[i], prev_dir, SHELL_HOME_DIR);
+        }
+        if (*pgid == 0) *pgid = pid;
+        setpgid(pid, *pgid);
+        pids[(*pid_count)++] = pid;
+    }
+    free_process_substitutions(subs);
+    return ok;
+}
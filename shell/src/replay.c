@@ -0,0 +1,312 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "../include/replay.h"
+#include "../include/parser.h"
+#include "../include/ast.h"
+#include "../include/hop.h"
+#include "../include/argv.h"
+
+extern int last_exit_status;
+
+#define RECORD_FIELD_COUNT 8
+#define CLASS_NAME_SIZE 32
+
+// A recording is one tab-separated line per input line:
+// start_us (since the session began), unix_time, cwd (where the line
+// started), parse_us, tokenize_us, run_us, status and the line itself,
+// which may contain tabs.
+static int record_fd = -1;
+static struct timespec session_start;
+static struct timespec line_start, parsed_at, tokenized_at;
+static char* recorded_line = NULL;
+static char* recorded_cwd = NULL;
+
+static long long elapsed_us(const struct timespec* from, const struct timespec* to) {
+    return (long long)(to->tv_sec - from->tv_sec) * 1000000 + (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
+bool record_open(const char* path) {
+    record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (record_fd == -1) {
+        perror(path);
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &session_start);
+    dprintf(record_fd, "# start_us\tunix_time\tcwd\tparse_us\ttokenize_us\trun_us\tstatus\tline\n");
+    return true;
+}
+
+void record_begin(const char* line) {
+    if (record_fd == -1) return;
+    free(recorded_line);
+    recorded_line = strdup(line);
+    // The line may change directory, and replay goes back here before it.
+    const char* cwd = current_directory();
+    free(recorded_cwd);
+    recorded_cwd = cwd ? strdup(cwd) : NULL;
+    clock_gettime(CLOCK_MONOTONIC, &line_start);
+    parsed_at = tokenized_at = line_start;
+}
+
+void record_parsed(void) {
+    if (record_fd == -1) return;
+    clock_gettime(CLOCK_MONOTONIC, &parsed_at);
+    tokenized_at = parsed_at;
+}
+
+void record_tokenized(void) {
+    if (record_fd == -1) return;
+    clock_gettime(CLOCK_MONOTONIC, &tokenized_at);
+}
+
+void record_end(void) {
+    if (record_fd == -1 || recorded_line == NULL) return;
+    struct timespec now, wall;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_REALTIME, &wall);
+    dprintf(record_fd, "%lld\t%lld.%06ld\t%s\t%lld\t%lld\t%lld\t%d\t%s\n",
+            elapsed_us(&session_start, &line_start), (long long)wall.tv_sec, wall.tv_nsec / 1000,
+            recorded_cwd ? recorded_cwd : "", elapsed_us(&line_start, &parsed_at), elapsed_us(&parsed_at, &tokenized_at),
+            elapsed_us(&tokenized_at, &now), last_exit_status, recorded_line);
+    free(recorded_line);
+    recorded_line = NULL;
+    free(recorded_cwd);
+    recorded_cwd = NULL;
+}
+
+// Latencies, in milliseconds, of the replayed lines of one class.
+typedef struct {
+    char name[CLASS_NAME_SIZE];
+    double* replayed;
+    double* recorded;
+    int count;
+    int capacity;
+    double total;
+} CommandClass;
+
+typedef struct {
+    CommandClass* items;
+    int count;
+    int capacity;
+} ClassTable;
+
+static CommandClass* find_class(ClassTable* table, const char* name) {
+    for (int i = 0; i < table->count; i++) {
+        if (strcmp(table->items[i].name, name) == 0) return &table->items[i];
+    }
+    if (table->count == table->capacity) {
+        int new_capacity = table->capacity ? table->capacity * 2 : 16;
+        CommandClass* grown = realloc(table->items, (size_t)new_capacity * sizeof(CommandClass));
+        if (!grown) return NULL;
+        table->items = grown;
+        table->capacity = new_capacity;
+    }
+    CommandClass* class = &table->items[table->count++];
+    memset(class, 0, sizeof(*class));
+    snprintf(class->name, sizeof(class->name), "%s", name);
+    return class;
+}
+
+static bool add_sample(CommandClass* class, double replayed_ms, double recorded_ms) {
+    if (class->count == class->capacity) {
+        int new_capacity = class->capacity ? class->capacity * 2 : 64;
+        double* replayed = realloc(class->replayed, (size_t)new_capacity * sizeof(double));
+        if (!replayed) return false;
+        class->replayed = replayed;
+        double* recorded = realloc(class->recorded, (size_t)new_capacity * sizeof(double));
+        if (!recorded) return false;
+        class->recorded = recorded;
+        class->capacity = new_capacity;
+    }
+    class->replayed[class->count] = replayed_ms;
+    class->recorded[class->count] = recorded_ms;
+    class->count++;
+    class->total += replayed_ms / 1000.0;
+    return true;
+}
+
+// The first word of the line, up to a space or operator.
+static void class_name(const char* line, char* name, size_t size) {
+    line += strspn(line, " \t");
+    size_t length = strcspn(line, " \t|;&<>");
+    if (length == 0) length = strcspn(line, " \t");
+    if (length >= size) length = size - 1;
+    memcpy(name, line, length);
+    name[length] = '\0';
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values.
+static double percentile(const double* sorted, int count, int p) {
+    int rank = (p * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static int compare_class_counts(const void* a, const void* b) {
+    return ((const CommandClass*)b)->count - ((const CommandClass*)a)->count;
+}
+
+static void print_report(ClassTable* table, int total_count, double wall_seconds) {
+    fprintf(stderr, "replayed %d commands in %.3f s, %.1f commands/s\n", total_count, wall_seconds,
+            wall_seconds > 0 ? total_count / wall_seconds : 0.0);
+    fprintf(stderr, "%-16s %7s %10s %10s %10s %12s %10s\n", "CLASS", "COUNT", "P50 ms", "P95 ms", "P99 ms",
+            "REC P50 ms", "CMDS/S");
+    qsort(table->items, (size_t)table->count, sizeof(CommandClass), compare_class_counts);
+    for (int i = 0; i < table->count; i++) {
+        CommandClass* class = &table->items[i];
+        qsort(class->replayed, (size_t)class->count, sizeof(double), compare_doubles);
+        qsort(class->recorded, (size_t)class->count, sizeof(double), compare_doubles);
+        fprintf(stderr, "%-16s %7d %10.3f %10.3f %10.3f %12.3f %10.1f\n", class->name, class->count,
+                percentile(class->replayed, class->count, 50), percentile(class->replayed, class->count, 95),
+                percentile(class->replayed, class->count, 99), percentile(class->recorded, class->count, 50),
+                class->total > 0 ? class->count / class->total : 0.0);
+    }
+}
+
+static void free_classes(ClassTable* table) {
+    for (int i = 0; i < table->count; i++) {
+        free(table->items[i].replayed);
+        free(table->items[i].recorded);
+    }
+    free(table->items);
+}
+
+// As main.c's process_line(), without adding to the history.
+static void replay_line(char* line, char** prev_dir, char* SHELL_HOME_DIR) {
+    if (!parse_input(line)) {
+        printf("Invalid Syntax!\n");
+        return;
+    }
+    ArgVector tokens = ARG_VECTOR_INIT;
+    tokenize_input(line, &tokens);
+    if (tokens.count > 0) {
+        run_tokens(tokens.items, tokens.count, prev_dir, SHELL_HOME_DIR);
+    }
+    arg_vector_free(&tokens);
+}
+
+// Splits a record into its fields, the last one being the rest of the line.
+static bool split_record(char* record, char** fields) {
+    for (int i = 0; i < RECORD_FIELD_COUNT - 1; i++) {
+        fields[i] = record;
+        char* tab = strchr(record, '\t');
+        if (!tab) return false;
+        *tab = '\0';
+        record = tab + 1;
+    }
+    fields[RECORD_FIELD_COUNT - 1] = record;
+    return true;
+}
+
+// The whole recording is read up front: a stdio stream would share its file
+// offset with forked children, whose exit() would seek it back.
+static char* read_recording(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror(path);
+        return NULL;
+    }
+    size_t length = 0, capacity = 65536;
+    char* data = malloc(capacity);
+    while (data != NULL) {
+        if (capacity - length < 4096) {
+            char* grown = realloc(data, capacity * 2);
+            if (!grown) break;
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + length, capacity - length - 1);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == 0) {
+            data[length] = '\0';
+            close(fd);
+            return data;
+        }
+        if (n < 0) break;
+        length += (size_t)n;
+    }
+    perror(path);
+    free(data);
+    close(fd);
+    return NULL;
+}
+
+bool run_replay(const char* path, bool max_speed, char** prev_dir, char* SHELL_HOME_DIR) {
+    char* recording = read_recording(path);
+    if (!recording) return false;
+
+    ClassTable table = { NULL, 0, 0 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int replayed = 0, malformed = 0;
+    char* next = recording;
+    while (next != NULL && *next != '\0') {
+        char* record = next;
+        char* newline = strchr(record, '\n');
+        if (newline) *newline = '\0';
+        next = newline ? newline + 1 : NULL;
+        if (record[0] == '#' || record[0] == '\0') continue;
+        char* fields[RECORD_FIELD_COUNT];
+        if (!split_record(record, fields)) {
+            malformed++;
+            continue;
+        }
+        char* line = fields[7];
+        char name[CLASS_NAME_SIZE];
+        class_name(line, name, sizeof(name));
+        // Ends the replay rather than the shell, so the report is printed.
+        if (strcmp(name, "exit") == 0) break;
+
+        if (!max_speed) {
+            long long offset = strtoll(fields[0], NULL, 10);
+            struct timespec due = start;
+            due.tv_sec += (time_t)(offset / 1000000);
+            due.tv_nsec += (long)(offset % 1000000) * 1000;
+            if (due.tv_nsec >= 1000000000) {
+                due.tv_sec++;
+                due.tv_nsec -= 1000000000;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {}
+        }
+        // Each line runs where it was recorded, without touching the
+        // directory stack, in case an earlier hop went elsewhere this time.
+        const char* cwd = current_directory();
+        if (fields[2][0] == '/' && (cwd == NULL || strcmp(cwd, fields[2]) != 0)) {
+            if (chdir(fields[2]) == 0) refresh_current_directory();
+        }
+        double recorded_ms = (strtoll(fields[3], NULL, 10) + strtoll(fields[4], NULL, 10) +
+                              strtoll(fields[5], NULL, 10)) / 1000.0;
+
+        struct timespec before, after;
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        replay_line(line, prev_dir, SHELL_HOME_DIR);
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        fflush(stdout);
+
+        CommandClass* class = find_class(&table, name);
+        if (!class || !add_sample(class, elapsed_us(&before, &after) / 1000.0, recorded_ms)) {
+            perror("replay");
+            break;
+        }
+        replayed++;
+    }
+    free(recording);
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (malformed > 0) fprintf(stderr, "replay: skipped %d malformed records\n", malformed);
+    print_report(&table, replayed, elapsed_us(&start, &end) / 1e6);
+    free_classes(&table);
+    return true;
+}
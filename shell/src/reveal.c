@@ -1,15 +1,242 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <strings.h>
 #include "../include/reveal.h"
 
+// Names are sorted as {key, name} pairs, where key holds the 8 bytes of the
+// name from the current depth, big-endian and padded with zeros, so that
+// comparing keys compares bytes as strcmp() does. Most of the work then
+// stays in the array instead of following pointers to the names.
+typedef struct {
+    uint64_t key;
+    const char* name;
+} SortItem;
+
+// Buckets this small are finished by insertion sort.
+#define INSERTION_SORT_LIMIT 32
+// Each level keeps about 4 KiB of counts on the stack.
+#define RADIX_MAX_LEVELS 64
+// From this many names, slices are sorted in threads and then merged.
+#define PARALLEL_SORT_MIN (1 << 20)
+#define MAX_SORT_THREADS 8
+
+// Only called where the name is known to have depth bytes before its end.
+static uint64_t load_key(const char* name, size_t depth) {
+    const unsigned char* p = (const unsigned char*)name + depth;
+    uint64_t key = 0;
+    for (int i = 0; i < 8 && p[i] != '\0'; i++) {
+        key |= (uint64_t)p[i] << (56 - 8 * i);
+    }
+    return key;
+}
+
+// A key whose last byte is set does not hold the end of its name.
+static int compare_items(const SortItem* a, const SortItem* b, size_t depth) {
+    if (a->key != b->key) return a->key < b->key ? -1 : 1;
+    if ((a->key & 0xff) == 0) return 0;
+    return strcmp(a->name + depth + 8, b->name + depth + 8);
+}
+
+static void insertion_sort(SortItem* items, size_t count, size_t depth) {
+    for (size_t i = 1; i < count; i++) {
+        SortItem item = items[i];
+        size_t j = i;
+        while (j > 0 && compare_items(&item, &items[j - 1], depth) < 0) {
+            items[j] = items[j - 1];
+            j--;
+        }
+        items[j] = item;
+    }
+}
+
+// Items that share a prefix only by their names, for the fallback below.
+static int compare_item_names(const void* a, const void* b) {
+    return strcmp(((const SortItem*)a)->name, ((const SortItem*)b)->name);
+}
+
+// MSD radix sort on byte `byte` of the keys, which agree on the bytes
+// before it. scratch has room for count items. Bytes all the items share
+// are stepped over in a loop, so each level of recursion splits the items;
+// past RADIX_MAX_LEVELS of those the rest goes to qsort().
+static void radix_sort(SortItem* items, SortItem* scratch, size_t count, size_t depth, int byte, int level) {
+    if (count <= INSERTION_SORT_LIMIT) {
+        insertion_sort(items, count, depth);
+        return;
+    }
+    if (level >= RADIX_MAX_LEVELS) {
+        qsort(items, count, sizeof(SortItem), compare_item_names);
+        return;
+    }
+
+    int shift;
+    size_t counts[256];
+    for (;;) {
+        shift = 56 - 8 * byte;
+        memset(counts, 0, sizeof(counts));
+        for (size_t i = 0; i < count; i++) {
+            counts[(items[i].key >> shift) & 0xff]++;
+        }
+        int shared = -1;
+        for (int c = 0; c < 256 && shared == -1; c++) {
+            if (counts[c] == count) shared = c;
+        }
+        if (shared == -1) break;
+        // Bucket 0 holds names that have ended, which are all equal.
+        if (shared == 0) return;
+        if (byte < 7) {
+            byte++;
+            continue;
+        }
+        depth += 8;
+        byte = 0;
+        for (size_t i = 0; i < count; i++) {
+            items[i].key = load_key(items[i].name, depth);
+        }
+    }
+
+    size_t next[256];
+    size_t offset = 0;
+    for (int c = 0; c < 256; c++) {
+        next[c] = offset;
+        offset += counts[c];
+    }
+    for (size_t i = 0; i < count; i++) {
+        scratch[next[(items[i].key >> shift) & 0xff]++] = items[i];
+    }
+    memcpy(items, scratch, count * sizeof(SortItem));
+
+    // next[c] is now where bucket c ends.
+    for (int c = 1; c < 256; c++) {
+        if (counts[c] < 2) continue;
+        size_t start = next[c] - counts[c];
+        SortItem* bucket = items + start;
+        if (byte < 7) {
+            radix_sort(bucket, scratch + start, counts[c], depth, byte + 1, level + 1);
+            continue;
+        }
+        for (size_t i = 0; i < counts[c]; i++) {
+            bucket[i].key = load_key(bucket[i].name, depth + 8);
+        }
+        radix_sort(bucket, scratch + start, counts[c], depth + 8, 0, level + 1);
+    }
+}
+
+typedef struct {
+    SortItem* items;
+    SortItem* scratch;
+    size_t count;
+} SortSlice;
+
+// Leaves the keys at depth 0 again for merging.
+static void* sort_slice(void* arg) {
+    SortSlice* slice = arg;
+    radix_sort(slice->items, slice->scratch, slice->count, 0, 0, 0);
+    for (size_t i = 0; i < slice->count; i++) {
+        slice->items[i].key = load_key(slice->items[i].name, 0);
+    }
+    return NULL;
+}
+
+typedef struct {
+    const SortItem* left;
+    size_t left_count;
+    const SortItem* right;
+    size_t right_count;
+    SortItem* out;
+} MergeRun;
+
+static void* merge_runs(void* arg) {
+    MergeRun* run = arg;
+    size_t i = 0, j = 0, k = 0;
+    while (i < run->left_count && j < run->right_count) {
+        // Ties take the left run first, so the merge is stable.
+        if (compare_items(&run->right[j], &run->left[i], 0) < 0) run->out[k++] = run->right[j++];
+        else run->out[k++] = run->left[i++];
+    }
+    memcpy(run->out + k, run->left + i, (run->left_count - i) * sizeof(SortItem));
+    k += run->left_count - i;
+    memcpy(run->out + k, run->right + j, (run->right_count - j) * sizeof(SortItem));
+    return NULL;
+}
+
+// Runs task(args[i]) for every i, in threads where they can be started.
+static void run_in_threads(void* (*task)(void*), void* args, size_t arg_size, int count) {
+    pthread_t threads[MAX_SORT_THREADS];
+    bool started[MAX_SORT_THREADS];
+    for (int i = 0; i < count; i++) {
+        void* arg = (char*)args + (size_t)i * arg_size;
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, task, arg) == 0;
+        if (!started[i]) task(arg);
+    }
+    for (int i = 0; i < count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+}
+
+static int sort_thread_count(size_t count) {
+    if (count < PARALLEL_SORT_MIN) return 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = 1;
+    while (threads * 2 <= MAX_SORT_THREADS && threads * 2 <= cpus) threads *= 2;
+    return threads;
+}
+
+// Sorts items by name in strcmp() order. Returns false if out of memory.
+static bool sort_items(SortItem* items, size_t count) {
+    if (count < 2) return true;
+    SortItem* scratch = malloc(count * sizeof(SortItem));
+    if (scratch == NULL) return false;
+    for (size_t i = 0; i < count; i++) {
+        items[i].key = load_key(items[i].name, 0);
+    }
+
+    int threads = sort_thread_count(count);
+    if (threads == 1) {
+        radix_sort(items, scratch, count, 0, 0, 0);
+        free(scratch);
+        return true;
+    }
+
+    // Sort one slice per thread, then merge pairs of runs until one is left,
+    // with the merges of each round in parallel.
+    SortSlice slices[MAX_SORT_THREADS];
+    size_t bounds[MAX_SORT_THREADS + 1];
+    for (int t = 0; t <= threads; t++) {
+        bounds[t] = count * (size_t)t / (size_t)threads;
+    }
+    for (int t = 0; t < threads; t++) {
+        slices[t] = (SortSlice){ items + bounds[t], scratch + bounds[t], bounds[t + 1] - bounds[t] };
+    }
+    run_in_threads(sort_slice, slices, sizeof(SortSlice), threads);
+
+    SortItem* from = items;
+    SortItem* to = scratch;
+    for (int width = 1; width < threads; width *= 2) {
+        MergeRun runs[MAX_SORT_THREADS / 2];
+        int run_count = 0;
+        for (int t = 0; t < threads; t += 2 * width) {
+            size_t start = bounds[t], middle = bounds[t + width], end = bounds[t + 2 * width];
+            runs[run_count++] = (MergeRun){ from + start, middle - start, from + middle, end - middle, to + start };
+        }
+        run_in_threads(merge_runs, runs, sizeof(MergeRun), run_count);
+        SortItem* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != items) memcpy(items, from, count * sizeof(SortItem));
+    free(scratch);
+    return true;
+}
+
 // Comparison function for qsort to sort strings (case sensitive sorting as in ls)
 int compare_strings(const void* a, const void* b) {
     const char* str_a = *(const char**)a;
@@ -17,11 +244,37 @@ int compare_strings(const void* a, const void* b) {
     return strcmp(str_a, str_b);
 }
 
+void sort_names(char** names, int count) {
+    if (count < 2) return;
+    SortItem* items = malloc((size_t)count * sizeof(SortItem));
+    if (items != NULL) {
+        for (int i = 0; i < count; i++) {
+            items[i].name = names[i];
+        }
+    }
+    if (items == NULL || !sort_items(items, (size_t)count)) {
+        free(items);
+        qsort(names, count, sizeof(char*), compare_strings);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        names[i] = (char*)items[i].name;
+    }
+    free(items);
+}
+
+// Natural order for -v: runs of digits compare as numbers, as in ls -v.
+static int compare_versions(const void* a, const void* b) {
+    return strverscmp(((const SortItem*)a)->name, ((const SortItem*)b)->name);
+}
+
 bool reveal(char** args, int num_args, char** prev_dir, const char* home_dir) {
     (void)home_dir; // home_dir is no longer needed here
 
     bool show_all = false;
     bool line_by_line = false;
+    bool version_sort = false;
+    bool reverse = false;
     const char* path_arg = NULL;
 
     // Parse flags and identify the path argument
@@ -30,6 +283,8 @@ bool reveal(char** args, int num_args, char** prev_dir, const char* home_dir) {
             for (size_t j = 1; j < strlen(args[i]); j++) {
                 if (args[i][j] == 'a') show_all = true;
                 else if (args[i][j] == 'l') line_by_line = true;
+                else if (args[i][j] == 'v') version_sort = true;
+                else if (args[i][j] == 'r') reverse = true;
             }
         } else {
             if (path_arg != NULL) {
@@ -62,57 +317,72 @@ bool reveal(char** args, int num_args, char** prev_dir, const char* home_dir) {
     DIR* dir = opendir(target_path);
     if (dir == NULL) {
         // perror("reveal");
-        printf("No such directory!\n"); 
+        printf("No such directory!\n");
         return false;
     }
 
+    // The names are packed one after another into a single arena.
     struct dirent* entry;
-    char** filenames = NULL;
-    int file_count = 0;
-    int max_files = 10;
-
-    filenames = (char**)malloc(max_files * sizeof(char*));
-    if (filenames == NULL) {
-        perror("reveal: malloc");
-        closedir(dir);
-        return false;
-    }
+    char* arena = NULL;
+    size_t arena_size = 0;
+    size_t arena_capacity = 0;
+    size_t file_count = 0;
 
     while ((entry = readdir(dir)) != NULL) {
         if (!show_all && entry->d_name[0] == '.') {
             continue;
         }
-        if (file_count >= max_files) {
-            max_files *= 2;
-            char** new_filenames = (char**)realloc(filenames, max_files * sizeof(char*));
-            if (new_filenames == NULL) {
+        size_t length = strlen(entry->d_name) + 1;
+        if (arena_size + length > arena_capacity) {
+            size_t new_capacity = arena_capacity ? arena_capacity * 2 : 4096;
+            while (new_capacity < arena_size + length) new_capacity *= 2;
+            char* new_arena = realloc(arena, new_capacity);
+            if (new_arena == NULL) {
                 perror("reveal: realloc");
-                for (int i = 0; i < file_count; i++) free(filenames[i]);
-                free(filenames);
+                free(arena);
                 closedir(dir);
                 return false;
             }
-            filenames = new_filenames;
+            arena = new_arena;
+            arena_capacity = new_capacity;
         }
-        filenames[file_count++] = strdup(entry->d_name);
+        memcpy(arena + arena_size, entry->d_name, length);
+        arena_size += length;
+        file_count++;
     }
     closedir(dir);
 
-    qsort(filenames, file_count, sizeof(char*), compare_strings);
+    SortItem* files = malloc((file_count ? file_count : 1) * sizeof(SortItem));
+    if (files == NULL) {
+        perror("reveal: malloc");
+        free(arena);
+        return false;
+    }
+    const char* name = arena;
+    for (size_t i = 0; i < file_count; i++) {
+        files[i].name = name;
+        name += strlen(name) + 1;
+    }
+
+    if (version_sort) {
+        qsort(files, file_count, sizeof(SortItem), compare_versions);
+    } else if (!sort_items(files, file_count)) {
+        perror("reveal: malloc");
+        free(files);
+        free(arena);
+        return false;
+    }
 
-    for (int i = 0; i < file_count; i++) {
-        printf("%s", filenames[i]);
-        if (line_by_line) {
-            printf("\n");
-        } else {
-            printf("  ");
-        }
-        free(filenames[i]);
+    const char* separator = line_by_line ? "\n" : "  ";
+    for (size_t i = 0; i < file_count; i++) {
+        fputs(files[reverse ? file_count - 1 - i : i].name, stdout);
+        fputs(separator, stdout);
     }
     if (!line_by_line && file_count > 0) {
         printf("\n");
     }
 
-    free(filenames);
+    free(files);
+    free(arena);
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,312 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "../include/script.h"
+#include "../include/parser.h"
+#include "../include/executor.h"
+#include "../include/ast.h"
+
+#define SCRIPT_CACHE_MAGIC "SHSCRPT"
+#define SCRIPT_CACHE_VERSION 4
+#define INVALID_RECORD UINT32_MAX
+
+// On-disk layout: header, the script's real path (padded to 8 bytes), then
+// one record per command line. A record is a token count, the byte length of
+// its token strings, and the NUL-terminated tokens themselves padded to 4
+// bytes. Lines that failed validation are kept as INVALID_RECORD so that the
+// error is still reported at the right point of the script.
+// SCRIPT_CACHE_VERSION covers this layout, and the header also records the
+// TOKENIZER_VERSION the records were made with.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_count;
+    uint64_t src_size;
+    int64_t src_mtime_sec;
+    int64_t src_mtime_nsec;
+    uint64_t src_ino;
+    uint64_t src_dev;
+    uint32_t path_length;
+    uint32_t tokenizer_version;
+    uint64_t data_size;
+} ScriptCacheHeader;
+
+typedef struct {
+    uint32_t token_count;
+    uint32_t byte_length;
+} ScriptRecord;
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+static bool buffer_append(ByteBuffer* buf, const void* bytes, size_t n) {
+    if (buf->size + n > buf->capacity) {
+        size_t new_capacity = buf->capacity ? buf->capacity : 4096;
+        while (new_capacity < buf->size + n) new_capacity *= 2;
+        char* new_data = realloc(buf->data, new_capacity);
+        if (!new_data) {
+            perror("script: realloc");
+            return false;
+        }
+        buf->data = new_data;
+        buf->capacity = new_capacity;
+    }
+    memcpy(buf->data + buf->size, bytes, n);
+    buf->size += n;
+    return true;
+}
+
+static bool buffer_pad(ByteBuffer* buf, size_t alignment) {
+    static const char zeros[8] = {0};
+    size_t padding = (alignment - buf->size % alignment) % alignment;
+    return buffer_append(buf, zeros, padding);
+}
+
+static uint64_t hash_path(const char* path) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char* p = (const unsigned char*)path; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool make_cache_dir(char* dir, size_t size) {
+    const char* base = getenv("XDG_CACHE_HOME");
+    if (base && base[0] != '\0') {
+        snprintf(dir, size, "%s/shell", base);
+    } else {
+        const char* home = getenv("HOME");
+        if (!home) return false;
+        snprintf(dir, size, "%s/.cache/shell", home);
+    }
+
+    // mkdir -p: create every missing component of the path.
+    for (char* p = dir + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(dir, 0700) != 0 && errno != EEXIST) return false;
+            *p = '/';
+        }
+    }
+    return mkdir(dir, 0700) == 0 || errno == EEXIST;
+}
+
+static bool get_cache_path(const char* real_path, char* cache_path, size_t size) {
+    char dir[PATH_MAX];
+    if (!make_cache_dir(dir, sizeof(dir))) return false;
+    int length = snprintf(cache_path, size, "%s/%016llx.bin", dir, (unsigned long long)hash_path(real_path));
+    return length > 0 && (size_t)length < size;
+}
+
+static bool header_matches(const ScriptCacheHeader* header, const struct stat* st) {
+    return memcmp(header->magic, SCRIPT_CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == SCRIPT_CACHE_VERSION &&
+           header->tokenizer_version == TOKENIZER_VERSION &&
+           header->src_size == (uint64_t)st->st_size &&
+           header->src_mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+           header->src_mtime_nsec == (int64_t)st->st_mtim.tv_nsec &&
+           header->src_ino == (uint64_t)st->st_ino &&
+           header->src_dev == (uint64_t)st->st_dev;
+}
+
+// Tokenizes and validates every line of the script into buf.
+static bool compile_script(const char* path, const char* real_path, const struct stat* st, ByteBuffer* buf) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+
+    ScriptCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCRIPT_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SCRIPT_CACHE_VERSION;
+    header.tokenizer_version = TOKENIZER_VERSION;
+    header.src_size = (uint64_t)st->st_size;
+    header.src_mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    header.src_mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    header.src_ino = (uint64_t)st->st_ino;
+    header.src_dev = (uint64_t)st->st_dev;
+    header.path_length = (uint32_t)strlen(real_path);
+
+    bool ok = buffer_append(buf, &header, sizeof(header)) &&
+              buffer_append(buf, real_path, header.path_length) &&
+              buffer_pad(buf, 8);
+    size_t data_start = buf->size;
+    uint32_t record_count = 0;
+
+    char* line = NULL;
+    size_t len = 0;
+    while (ok && getline(&line, &len, fp) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        size_t skip = strspn(line, " \t\r");
+        if (line[skip] == '\0' || line[skip] == '#') {
+            continue;
+        }
+
+        ScriptRecord record = { INVALID_RECORD, 0 };
+        if (!parse_input(line)) {
+            ok = buffer_append(buf, &record, sizeof(record));
+            record_count++;
+            continue;
+        }
+
+        ArgVector tokens = ARG_VECTOR_INIT;
+        tokenize_input(line, &tokens);
+        if (tokens.count == 0) continue;
+
+        size_t record_offset = buf->size;
+        record.token_count = (uint32_t)tokens.count;
+        ok = buffer_append(buf, &record, sizeof(record));
+        for (int i = 0; i < tokens.count && ok; i++) {
+            ok = buffer_append(buf, tokens.items[i], strlen(tokens.items[i]) + 1);
+        }
+        arg_vector_free(&tokens);
+        if (!ok) break;
+        ((ScriptRecord*)(buf->data + record_offset))->byte_length =
+            (uint32_t)(buf->size - record_offset - sizeof(ScriptRecord));
+        ok = buffer_pad(buf, 4);
+        record_count++;
+    }
+    free(line);
+    fclose(fp);
+
+    if (ok) {
+        ScriptCacheHeader* out = (ScriptCacheHeader*)buf->data;
+        out->record_count = record_count;
+        out->data_size = buf->size - data_start;
+    }
+    return ok;
+}
+
+// Writes the compiled form next to its final name and renames it into place,
+// so concurrent runs never observe a partially written cache.
+static void write_cache(const char* cache_path, const ByteBuffer* buf) {
+    char tmp_path[PATH_MAX];
+    int length = snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", cache_path, (int)getpid());
+    if (length < 0 || (size_t)length >= sizeof(tmp_path)) return;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) return;
+
+    size_t written = 0;
+    while (written < buf->size) {
+        ssize_t n = write(fd, buf->data + written, buf->size - written);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            close(fd);
+            unlink(tmp_path);
+            return;
+        }
+        written += (size_t)n;
+    }
+    close(fd);
+    if (rename(tmp_path, cache_path) != 0) {
+        unlink(tmp_path);
+    }
+}
+
+// Maps a cache file if it is still valid for the script described by st.
+static char* map_cache(const char* cache_path, const char* real_path, const struct stat* st, size_t* mapped_size) {
+    int fd = open(cache_path, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    struct stat cache_st;
+    if (fstat(fd, &cache_st) != 0 || (size_t)cache_st.st_size < sizeof(ScriptCacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)cache_st.st_size;
+    char* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    const ScriptCacheHeader* header = (const ScriptCacheHeader*)data;
+    size_t path_end = sizeof(ScriptCacheHeader) + header->path_length;
+    size_t data_start = (path_end + 7) & ~(size_t)7;
+    if (!header_matches(header, st) || data_start > size ||
+        header->data_size != size - data_start ||
+        header->path_length != strlen(real_path) ||
+        memcmp(data + sizeof(ScriptCacheHeader), real_path, header->path_length) != 0) {
+        munmap(data, size);
+        return NULL;
+    }
+
+    *mapped_size = size;
+    return data;
+}
+
+static void execute_records(char* data, size_t size, char** prev_dir, char* SHELL_HOME_DIR) {
+    const ScriptCacheHeader* header = (const ScriptCacheHeader*)data;
+    size_t offset = (sizeof(ScriptCacheHeader) + header->path_length + 7) & ~(size_t)7;
+
+    for (uint32_t r = 0; r < header->record_count && offset + sizeof(ScriptRecord) <= size; r++) {
+        const ScriptRecord* record = (const ScriptRecord*)(data + offset);
+        offset += sizeof(ScriptRecord);
+        if (record->token_count == INVALID_RECORD) {
+            printf("Invalid Syntax!\n");
+            continue;
+        }
+
+        // The tokens are borrowed straight from the mapping.
+        ArgVector tokens = ARG_VECTOR_INIT;
+        char* p = data + offset;
+        for (uint32_t i = 0; i < record->token_count; i++) {
+            arg_vector_push(&tokens, p, false);
+            p += strlen(p) + 1;
+        }
+        offset += (record->byte_length + 3) & ~(size_t)3;
+
+        if (r + 1 == header->record_count) run_last_tokens(tokens.items, tokens.count, prev_dir, SHELL_HOME_DIR);
+        else run_tokens(tokens.items, tokens.count, prev_dir, SHELL_HOME_DIR);
+        arg_vector_free(&tokens);
+    }
+}
+
+bool run_script(const char* path, char** prev_dir, char* SHELL_HOME_DIR) {
+    char real_path[PATH_MAX];
+    struct stat st;
+    if (realpath(path, real_path) == NULL || stat(real_path, &st) != 0) {
+        perror(path);
+        return false;
+    }
+
+    char cache_path[PATH_MAX];
+    bool have_cache_path = get_cache_path(real_path, cache_path, sizeof(cache_path));
+
+    if (have_cache_path) {
+        size_t mapped_size = 0;
+        char* mapped = map_cache(cache_path, real_path, &st, &mapped_size);
+        if (mapped) {
+            execute_records(mapped, mapped_size, prev_dir, SHELL_HOME_DIR);
+            munmap(mapped, mapped_size);
+            return true;
+        }
+    }
+
+    ByteBuffer buf = { NULL, 0, 0 };
+    if (!compile_script(path, real_path, &st, &buf)) {
+        free(buf.data);
+        return false;
+    }
+    if (have_cache_path) {
+        write_cache(cache_path, &buf);
+    }
+    execute_records(buf.data, buf.size, prev_dir, SHELL_HOME_DIR);
+    free(buf.data);
+    return true;
+}
@@ -0,0 +1,274 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "../include/server.h"
+#include "../include/parser.h"
+#include "../include/ast.h"
+#include "../include/jobs.h"
+#include "../include/hop.h"
+#include "../include/zygote.h"
+
+extern int last_exit_status;
+
+// A client opens with a ClientHello carrying its stdin, stdout and stderr as
+// SCM_RIGHTS, followed by cwd_length bytes of cwd. After that it sends
+// command lines and the session answers each one with "<status>\n".
+typedef struct {
+    uint32_t cwd_length;
+} ClientHello;
+
+static bool fill_address(struct sockaddr_un* address, const char* path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+static bool read_exact(int fd, void* buffer, size_t length) {
+    char* p = buffer;
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void* buffer, size_t length) {
+    const char* p = buffer;
+    while (length > 0) {
+        ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Takes over the client's fds and cwd. Returns false if the hello is bad.
+static bool accept_hello(int sock) {
+    ClientHello hello;
+    int fds[3];
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &hello, sizeof(hello) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(sock, &msg, MSG_WAITALL) != (ssize_t)sizeof(hello)) return false;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) return false;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    for (int i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+
+    char cwd[PATH_MAX];
+    if (hello.cwd_length >= sizeof(cwd) || !read_exact(sock, cwd, hello.cwd_length)) return false;
+    cwd[hello.cwd_length] = '\0';
+    if (chdir(cwd) == -1) perror(cwd);
+    refresh_current_directory();
+    return true;
+}
+
+static void run_session_line(char* line, char** prev_dir, char* SHELL_HOME_DIR) {
+    line[strcspn(line, "\n")] = '\0';
+    if (strspn(line, " \t\r") == strlen(line)) return;
+    if (!parse_input(line)) {
+        printf("Invalid Syntax!\n");
+        last_exit_status = 2;
+        return;
+    }
+
+    ArgVector tokens = ARG_VECTOR_INIT;
+    tokenize_input(line, &tokens);
+    run_tokens(tokens.items, tokens.count, prev_dir, SHELL_HOME_DIR);
+    arg_vector_free(&tokens);
+}
+
+static void run_session(int sock, char** prev_dir, char* SHELL_HOME_DIR) {
+    if (!accept_hello(sock)) _exit(1);
+    FILE* requests = fdopen(sock, "r");
+    if (!requests) _exit(1);
+
+    char* line = NULL;
+    size_t capacity = 0;
+    while (getline(&line, &capacity, requests) != -1) {
+        last_exit_status = 0;
+        run_session_line(line, prev_dir, SHELL_HOME_DIR);
+        fflush(stdout);
+        fflush(stderr);
+        char reply[16];
+        int length = snprintf(reply, sizeof(reply), "%d\n", last_exit_status);
+        if (!write_all(sock, reply, (size_t)length)) break;
+    }
+    free(line);
+    check_and_kill_all_jobs();
+    exit(0);
+}
+
+bool run_server(const char* path, char** prev_dir, char* SHELL_HOME_DIR) {
+    struct sockaddr_un address;
+    if (!fill_address(&address, path)) return false;
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener == -1) {
+        perror("socket");
+        return false;
+    }
+    // Only a socket left behind by an earlier server is replaced.
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s: exists and is not a socket\n", path);
+            close(listener);
+            return false;
+        }
+        unlink(path);
+    }
+    // Sessions run commands as this user, so only this user may connect.
+    mode_t old_mask = umask(0177);
+    bool bound = bind(listener, (struct sockaddr*)&address, sizeof(address)) == 0;
+    umask(old_mask);
+    if (!bound || listen(listener, SOMAXCONN) == -1) {
+        perror(path);
+        close(listener);
+        return false;
+    }
+
+    // Sessions are reaped by the kernel. Each session puts SIGCHLD back so
+    // it can wait for its own commands.
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        int sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (sock == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            close(listener);
+            return false;
+        }
+        // The socket's mode is the first check; the peer's uid is the second,
+        // for a socket whose directory or mode was opened up afterwards.
+        struct ucred peer;
+        socklen_t peer_length = sizeof(peer);
+        if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &peer, &peer_length) == -1 || peer.uid != geteuid()) {
+            fprintf(stderr, "%s: refused a client of another user\n", path);
+            close(sock);
+            continue;
+        }
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            // The server's helpers are not this session's children, so it
+            // could not wait for the commands it gave them.
+            zygote_pool_detach();
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGPIPE, SIG_DFL);
+            close(listener);
+            run_session(sock, prev_dir, SHELL_HOME_DIR);
+        }
+        if (pid == -1) perror("fork");
+        close(sock);
+    }
+}
+
+static bool send_hello(int sock, int stdin_fd) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return false;
+    }
+
+    ClientHello hello = { (uint32_t)strlen(cwd) };
+    int fds[3] = { stdin_fd, STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &hello, sizeof(hello) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hello)) return false;
+    return write_all(sock, cwd, hello.cwd_length);
+}
+
+// Sends one command line and waits for its status. Returns -1 if the
+// session went away (for example after `exit`).
+static int run_remote(int sock, FILE* replies, const char* command) {
+    size_t length = strcspn(command, "\n");
+    if (!write_all(sock, command, length) || !write_all(sock, "\n", 1)) return -1;
+    char reply[16];
+    if (fgets(reply, sizeof(reply), replies) == NULL) return -1;
+    return atoi(reply);
+}
+
+int run_client(const char* path, int command_count, char** commands) {
+    struct sockaddr_un address;
+    if (!fill_address(&address, path)) return 1;
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        perror(path);
+        return 1;
+    }
+    // When the commands come from stdin, the session gets /dev/null instead
+    // so commands cannot read the rest of the script.
+    int stdin_fd = command_count > 0 ? STDIN_FILENO : open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (stdin_fd == -1 || !send_hello(sock, stdin_fd)) {
+        fprintf(stderr, "%s: handshake failed\n", path);
+        return 1;
+    }
+    FILE* replies = fdopen(sock, "r");
+    if (!replies) {
+        perror("fdopen");
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = 0; i < command_count && status != -1; i++) {
+        status = run_remote(sock, replies, commands[i]);
+    }
+    if (command_count == 0) {
+        char* line = NULL;
+        size_t capacity = 0;
+        while (status != -1 && getline(&line, &capacity, stdin) != -1) {
+            status = run_remote(sock, replies, line);
+        }
+        free(line);
+    }
+    fclose(replies);
+    return status == -1 ? 0 : status;
+}
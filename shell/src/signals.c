@@ -1,13 +1,19 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/signalfd.h>
 #include "../include/signals.h"
 
 // External global variables
 extern pid_t foreground_pid;
 
+static int signal_fd = -1;
+
 void ping(pid_t pid, int signal_number) {
     int actual_signal = ((signal_number % 32) + 32) % 32;
     if (kill(pid, actual_signal) == -1) {
@@ -18,6 +24,8 @@ void ping(pid_t pid, int signal_number) {
     }
 }
 
+// These run from the event loop, not from a signal handler, so they are free
+// to report errors.
 void handle_sigint(int signo) {
     (void)signo;
     if (foreground_pid != -1) {
@@ -36,9 +44,103 @@ void handle_sigtstp(int signo) {
     }
 }
 
-void setup_signal_handlers(void) {
-    signal(SIGINT, handle_sigint);
-    signal(SIGTSTP, handle_sigtstp);
-    signal(SIGTTOU, SIG_IGN);
-    signal(SIGTTIN, SIG_IGN);
+static void shell_signal_set(sigset_t* set) {
+    sigemptyset(set);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGTSTP);
+    sigaddset(set, SIGCHLD);
+}
+
+int setup_signal_handlers(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTTOU, &sa, NULL);
+    sigaction(SIGTTIN, &sa, NULL);
+
+    // SIGINT, SIGTSTP and SIGCHLD are blocked and read from a signalfd by
+    // the event loop instead of interrupting the shell asynchronously.
+    sigset_t set;
+    shell_signal_set(&set);
+    if (sigprocmask(SIG_BLOCK, &set, NULL) == -1) {
+        perror("sigprocmask");
+        return -1;
+    }
+    signal_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd == -1) {
+        perror("signalfd");
+    }
+    return signal_fd;
+}
+
+int get_signal_fd(void) {
+    return signal_fd;
+}
+
+int read_pending_signal(int fd) {
+    struct signalfd_siginfo info;
+    ssize_t n = read(fd, &info, sizeof(info));
+    if (n != sizeof(info)) {
+        return 0;
+    }
+    return (int)info.ssi_signo;
+}
+
+bool interrupt_requested(void) {
+    if (signal_fd == -1) return false;
+    sigset_t pending;
+    if (sigpending(&pending) == -1 || !sigismember(&pending, SIGINT)) {
+        return false;
+    }
+    // Consume it so the prompt does not react to it a second time.
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    struct timespec no_wait = { 0, 0 };
+    sigtimedwait(&set, NULL, &no_wait);
+    return true;
+}
+
+bool wait_for_interrupt(long timeout_ms) {
+    struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    if (signal_fd == -1) {
+        nanosleep(&timeout, NULL);
+        return false;
+    }
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    return sigtimedwait(&set, NULL, &timeout) == SIGINT;
+}
+
+void reset_child_signals(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTSTP, &sa, NULL);
+    sigaction(SIGTTOU, &sa, NULL);
+    sigaction(SIGTTIN, &sa, NULL);
+
+    // The blocked mask survives exec, so it has to be cleared explicitly.
+    sigset_t set;
+    shell_signal_set(&set);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+    if (signal_fd != -1) {
+        close(signal_fd);
+        signal_fd = -1;
+    }
+}
+
+void claim_terminal(void) {
+    // The group may still be in the background; with SIGTTOU blocked it can
+    // take the terminal over instead of being stopped.
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    tcsetpgrp(STDIN_FILENO, getpgrp());
+    sigprocmask(SIG_SETMASK, &old, NULL);
 }
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include "../include/timeout.h"
+#include "../include/jobs.h"
+#include "../include/eventloop.h"
+
+#define DEFAULT_GRACE_MS 5000
+
+static long long now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// "1.5", "90s", "2m", "1h", "1d". Returns -1 if malformed.
+static long long parse_duration(const char* text) {
+    char* end;
+    errno = 0;
+    double value = strtod(text, &end);
+    if (end == text || errno != 0 || value < 0) return -1;
+    double scale = 1000;
+    if (*end == 'm') scale *= 60;
+    else if (*end == 'h') scale *= 3600;
+    else if (*end == 'd') scale *= 86400;
+    else if (*end != 's' && *end != '\0') return -1;
+    if (*end != '\0' && end[1] != '\0') return -1;
+    return (long long)(value * scale + 0.5);
+}
+
+int parse_timeout(char** tokens, int token_count, JobTimeout* timeout) {
+    memset(timeout, 0, sizeof(*timeout));
+    if (token_count == 0 || strcmp(tokens[0], "timeout") != 0) return 0;
+
+    int i = 1;
+    long long grace = DEFAULT_GRACE_MS;
+    if (i + 1 < token_count && strcmp(tokens[i], "-k") == 0) {
+        grace = parse_duration(tokens[i + 1]);
+        i += 2;
+    }
+    long long duration = i < token_count ? parse_duration(tokens[i]) : -1;
+    if (grace < 0 || duration < 0 || i + 1 >= token_count) {
+        fprintf(stderr, "Syntax: timeout [-k grace] duration command [arg...]\n");
+        return -1;
+    }
+    // As in timeout(1), a zero duration disables the timeout.
+    if (duration > 0) timeout->deadline = now_ms() + duration;
+    timeout->grace_ms = (long)grace;
+    return i + 1;
+}
+
+// Sends whatever signal is due. Returns the milliseconds until the next one,
+// or -1 when nothing is left to do.
+static long long timeout_step(pid_t pgid, JobTimeout* timeout) {
+    if (timeout->deadline == 0 || timeout->killed) return -1;
+    long long now = now_ms();
+    if (!timeout->terminated) {
+        if (now < timeout->deadline) return timeout->deadline - now;
+        kill(-pgid, SIGTERM);
+        // A stopped job has to run to act on it.
+        kill(-pgid, SIGCONT);
+        timeout->terminated = true;
+    }
+    long long kill_at = timeout->deadline + timeout->grace_ms;
+    if (now < kill_at) return kill_at - now;
+    kill(-pgid, SIGKILL);
+    timeout->killed = true;
+    return -1;
+}
+
+long long timeout_enforce_jobs(void) {
+    long long next = -1;
+    for (int i = 0; i < background_job_count; i++) {
+        long long due = timeout_step(background_jobs[i].pid, &background_jobs[i].timeout);
+        if (due >= 0 && (next == -1 || due < next)) next = due;
+    }
+    return next;
+}
+
+pid_t timeout_waitpid(pid_t pid, int* status, pid_t pgid, JobTimeout* timeout) {
+    return timeout_waitpid_serving(pid, status, pgid, timeout, -1, NULL, NULL);
+}
+
+pid_t timeout_waitpid_serving(pid_t pid, int* status, pid_t pgid, JobTimeout* timeout, int fd, bool (*serve)(void*), void* data) {
+    if (timeout->deadline == 0 && fd == -1 && timeout_enforce_jobs() == -1) {
+        return waitpid(pid, status, WUNTRACED);
+    }
+
+    // With SIGCHLD blocked and read from a signalfd, a child that changes
+    // state between waitpid() and poll() still wakes the poll.
+    sigset_t chld, old_mask;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &old_mask);
+    int signal_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    pid_t result;
+    bool consumed = false;
+    for (;;) {
+        result = waitpid(pid, status, WUNTRACED | WNOHANG);
+        if (result != 0) break;
+        if (signal_fd == -1 || timer_fd == -1) {
+            // Without the fds, fall back to enforcing nothing.
+            result = waitpid(pid, status, WUNTRACED);
+            break;
+        }
+
+        // Background jobs' deadlines fall due while the shell waits here too.
+        long long next = timeout_step(pgid, timeout);
+        long long jobs_next = timeout_enforce_jobs();
+        if (jobs_next >= 0 && (next == -1 || jobs_next < next)) next = jobs_next;
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        if (next >= 0) {
+            spec.it_value.tv_sec = next / 1000;
+            spec.it_value.tv_nsec = (next % 1000) * 1000000L;
+            if (next == 0) spec.it_value.tv_nsec = 1;
+        }
+        timerfd_settime(timer_fd, 0, &spec, NULL);
+
+        // poll() skips the third entry once fd is -1.
+        struct pollfd fds[3] = { { signal_fd, POLLIN, 0 }, { timer_fd, POLLIN, 0 }, { fd, POLLIN, 0 } };
+        if (poll(fds, 3, -1) == -1 && errno != EINTR) {
+            perror("timeout: poll");
+            result = waitpid(pid, status, WUNTRACED);
+            break;
+        }
+        struct signalfd_siginfo info;
+        while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+            consumed = true;
+        }
+        if (fd != -1 && fds[2].revents != 0 && !serve(data)) fd = -1;
+        uint64_t expirations;
+        if (read(timer_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+            perror("timeout: read");
+        }
+    }
+
+    if (signal_fd != -1) close(signal_fd);
+    if (timer_fd != -1) close(timer_fd);
+    // The event loop reports background jobs on SIGCHLD; hand back the ones
+    // read here.
+    if (consumed && sigismember(&old_mask, SIGCHLD)) raise(SIGCHLD);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return result;
+}
+
+static BackgroundJob* find_job_by_pgid(pid_t pgid) {
+    for (int i = 0; i < background_job_count; i++) {
+        if (background_jobs[i].pid == pgid) return &background_jobs[i];
+    }
+    return NULL;
+}
+
+static void on_job_timer(int fd, void* data) {
+    (void)fd;
+    pid_t pgid = (pid_t)(intptr_t)data;
+    BackgroundJob* job = find_job_by_pgid(pgid);
+    // Gone already; the pgid may even have been reused by an untimed job.
+    if (job == NULL || job->timeout.deadline == 0) return;
+    long long next = timeout_step(pgid, &job->timeout);
+    if (next >= 0) event_loop_add_timer((long)next, false, on_job_timer, data);
+}
+
+void timeout_watch_job(pid_t pgid, const JobTimeout* timeout) {
+    if (timeout->deadline == 0) return;
+    BackgroundJob* job = find_job_by_pgid(pgid);
+    if (job == NULL) return;
+    job->timeout = *timeout;
+    long long next = timeout_step(pgid, &job->timeout);
+    if (next >= 0) event_loop_add_timer((long)next, false, on_job_timer, (void*)(intptr_t)pgid);
+}
+
+int timeout_exit_code(const JobTimeout* timeout, int code) {
+    if (timeout->killed) return 137;
+    if (timeout->terminated) return 124;
+    return code;
+}
@@ -0,0 +1,368 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "../include/utilities.h"
+#include "../include/signals.h"
+
+#define COPY_CHUNK (1 << 20)
+
+// Output errors only show up once the buffer is flushed.
+static int finish_output(const char* name) {
+    if (fflush(stdout) == EOF) {
+        fprintf(stderr, "%s: write error: %s\n", name, strerror(errno));
+        clearerr(stdout);
+        return 1;
+    }
+    return 0;
+}
+
+// Prints word with echo -e's backslash escapes. Returns false after \c,
+// which ends all output.
+static bool print_escaped(const char* word) {
+    for (const char* p = word; *p != '\0'; p++) {
+        if (*p != '\\' || p[1] == '\0') {
+            putchar(*p);
+            continue;
+        }
+        switch (*++p) {
+            case 'a': putchar('\a'); break;
+            case 'b': putchar('\b'); break;
+            case 'c': return false;
+            case 'e': putchar('\033'); break;
+            case 'f': putchar('\f'); break;
+            case 'n': putchar('\n'); break;
+            case 'r': putchar('\r'); break;
+            case 't': putchar('\t'); break;
+            case 'v': putchar('\v'); break;
+            case '\\': putchar('\\'); break;
+            case '0': case 'x': {
+                // \0nnn octal or \xHH hex, as many digits as follow.
+                bool hex = (*p == 'x');
+                const char* allowed = hex ? "0123456789abcdefABCDEF" : "01234567";
+                int value = 0, digits = 0;
+                while (digits < (hex ? 2 : 3) && p[1] != '\0' && strchr(allowed, p[1]) != NULL) {
+                    char digit = *++p;
+                    value = value * (hex ? 16 : 8) + (digit <= '9' ? digit - '0' : (digit | 0x20) - 'a' + 10);
+                    digits++;
+                }
+                if (hex && digits == 0) {
+                    fputs("\\x", stdout);
+                } else {
+                    putchar(value);
+                }
+                break;
+            }
+            default:
+                putchar('\\');
+                putchar(*p);
+        }
+    }
+    return true;
+}
+
+int echo_command(char** tokens, int token_count) {
+    bool newline = true, escapes = false;
+    int i = 1;
+    // As in bash, only words made up entirely of n, e and E are options.
+    for (; i < token_count && tokens[i][0] == '-' && tokens[i][1] != '\0' &&
+           strspn(tokens[i] + 1, "neE") == strlen(tokens[i] + 1); i++) {
+        for (const char* p = tokens[i] + 1; *p != '\0'; p++) {
+            if (*p == 'n') newline = false;
+            else escapes = (*p == 'e');
+        }
+    }
+    for (int first = i; i < token_count; i++) {
+        if (i > first) putchar(' ');
+        if (!escapes) {
+            fputs(tokens[i], stdout);
+        } else if (!print_escaped(tokens[i])) {
+            newline = false;
+            break;
+        }
+    }
+    if (newline) putchar('\n');
+    return finish_output("echo");
+}
+
+// test: a recursive-descent parser over the arguments, with -o binding
+// looser than -a, and -a looser than !.
+typedef struct {
+    char** args;
+    int count;
+    int pos;
+    bool error;
+    bool reported;      // the error has been printed already
+} TestParser;
+
+static bool test_or(TestParser* p);
+
+static bool parse_integer(TestParser* p, const char* word, long long* value) {
+    char* end;
+    errno = 0;
+    *value = strtoll(word, &end, 10);
+    if (end == word || *end != '\0' || errno != 0) {
+        fprintf(stderr, "test: %s: integer expression expected\n", word);
+        p->error = p->reported = true;
+        return false;
+    }
+    return true;
+}
+
+static bool is_binary_operator(const char* word) {
+    static const char* const operators[] = {
+        "=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL
+    };
+    for (int i = 0; operators[i] != NULL; i++) {
+        if (strcmp(word, operators[i]) == 0) return true;
+    }
+    return false;
+}
+
+static bool test_binary(TestParser* p, const char* left, const char* op, const char* right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(left, right) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(left, right) != 0;
+
+    if (op[1] == 'n' || op[1] == 'o' || strcmp(op, "-ef") == 0) {
+        struct stat a, b;
+        bool have_a = stat(left, &a) == 0, have_b = stat(right, &b) == 0;
+        if (strcmp(op, "-ef") == 0) return have_a && have_b && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+        // A missing file counts as older than any existing one.
+        if (strcmp(op, "-nt") == 0) {
+            return have_a && (!have_b || a.st_mtim.tv_sec > b.st_mtim.tv_sec ||
+                              (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec > b.st_mtim.tv_nsec));
+        }
+        return have_b && (!have_a || a.st_mtim.tv_sec < b.st_mtim.tv_sec ||
+                          (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec < b.st_mtim.tv_nsec));
+    }
+
+    long long a, b;
+    if (!parse_integer(p, left, &a) || !parse_integer(p, right, &b)) return false;
+    if (strcmp(op, "-eq") == 0) return a == b;
+    if (strcmp(op, "-ne") == 0) return a != b;
+    if (strcmp(op, "-lt") == 0) return a < b;
+    if (strcmp(op, "-le") == 0) return a <= b;
+    if (strcmp(op, "-gt") == 0) return a > b;
+    return a >= b;
+}
+
+static bool test_unary(TestParser* p, char op, const char* arg) {
+    struct stat st;
+    switch (op) {
+        case 'n': return arg[0] != '\0';
+        case 'z': return arg[0] == '\0';
+        case 'e': return stat(arg, &st) == 0;
+        case 'f': return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd': return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+        case 'p': return stat(arg, &st) == 0 && S_ISFIFO(st.st_mode);
+        case 'S': return stat(arg, &st) == 0 && S_ISSOCK(st.st_mode);
+        case 'b': return stat(arg, &st) == 0 && S_ISBLK(st.st_mode);
+        case 'c': return stat(arg, &st) == 0 && S_ISCHR(st.st_mode);
+        case 's': return stat(arg, &st) == 0 && st.st_size > 0;
+        case 'h': case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        case 't': {
+            long long fd;
+            return parse_integer(p, arg, &fd) && isatty((int)fd);
+        }
+    }
+    return false;
+}
+
+static bool is_unary_operator(const char* word) {
+    return word[0] == '-' && word[1] != '\0' && word[2] == '\0' && strchr("nzefdpSbcshLrwxt", word[1]) != NULL;
+}
+
+static bool test_primary(TestParser* p) {
+    if (p->pos >= p->count) {
+        p->error = true;
+        return false;
+    }
+    char** args = p->args + p->pos;
+    int left = p->count - p->pos;
+
+    // A binary expression wins, so `test -n = -n` compares strings.
+    if (left >= 3 && is_binary_operator(args[1])) {
+        p->pos += 3;
+        return test_binary(p, args[0], args[1], args[2]);
+    }
+    if (strcmp(args[0], "(") == 0 && left >= 2) {
+        p->pos++;
+        bool result = test_or(p);
+        if (p->pos >= p->count || strcmp(p->args[p->pos], ")") != 0) {
+            p->error = true;
+            return false;
+        }
+        p->pos++;
+        return result;
+    }
+    if (left >= 2 && is_unary_operator(args[0])) {
+        p->pos += 2;
+        return test_unary(p, args[0][1], args[1]);
+    }
+    // A lone word is true when it is not empty.
+    p->pos++;
+    return args[0][0] != '\0';
+}
+
+static bool test_not(TestParser* p) {
+    if (p->pos + 1 < p->count && strcmp(p->args[p->pos], "!") == 0) {
+        p->pos++;
+        return !test_not(p);
+    }
+    return test_primary(p);
+}
+
+static bool test_and(TestParser* p) {
+    bool result = test_not(p);
+    while (!p->error && p->pos < p->count && strcmp(p->args[p->pos], "-a") == 0) {
+        p->pos++;
+        bool right = test_not(p);
+        result = result && right;
+    }
+    return result;
+}
+
+static bool test_or(TestParser* p) {
+    bool result = test_and(p);
+    while (!p->error && p->pos < p->count && strcmp(p->args[p->pos], "-o") == 0) {
+        p->pos++;
+        bool right = test_and(p);
+        result = result || right;
+    }
+    return result;
+}
+
+int test_command(char** tokens, int token_count) {
+    const char* name = tokens[0];
+    int count = token_count - 1;
+    if (strcmp(name, "[") == 0) {
+        if (count == 0 || strcmp(tokens[token_count - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ]\n");
+            return 2;
+        }
+        count--;
+    }
+    // No expression is false.
+    if (count == 0) return 1;
+
+    TestParser parser = { tokens + 1, count, 0, false, false };
+    bool result = test_or(&parser);
+    if (!parser.error && parser.pos < parser.count) {
+        fprintf(stderr, "%s: %s: unexpected argument\n", name, parser.args[parser.pos]);
+        return 2;
+    }
+    if (parser.error) {
+        if (!parser.reported) fprintf(stderr, "%s: syntax error\n", name);
+        return 2;
+    }
+    return result ? 0 : 1;
+}
+
+// Waits for input on a pipe or terminal, giving up if Ctrl-C reaches the
+// shell: cat runs inside it, where SIGINT does not interrupt a read().
+static bool wait_readable(int fd) {
+    for (;;) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 100);
+        if (interrupt_requested()) return false;
+        if (ready != 0) return true;
+    }
+}
+
+// Copies in to stdout: sendfile() from a regular file, splice() when either
+// side is a pipe, and read()/write() otherwise.
+static bool copy_fd(int in) {
+    struct stat st;
+    bool regular = fstat(in, &st) == 0 && S_ISREG(st.st_mode);
+    bool use_sendfile = regular, use_splice = !regular;
+    char* buffer = NULL;
+    bool ok = true;
+
+    for (;;) {
+        if (!regular && !wait_readable(in)) break;
+        ssize_t n;
+        if (use_sendfile) {
+            n = sendfile(STDOUT_FILENO, in, NULL, COPY_CHUNK);
+            if (n == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                use_sendfile = false;
+                continue;
+            }
+        } else if (use_splice) {
+            n = splice(in, NULL, STDOUT_FILENO, NULL, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n == -1 && errno == EINVAL) {
+                use_splice = false;
+                continue;
+            }
+        } else {
+            if (buffer == NULL && (buffer = malloc(COPY_CHUNK / 16)) == NULL) {
+                perror("cat");
+                ok = false;
+                break;
+            }
+            n = read(in, buffer, COPY_CHUNK / 16);
+            for (ssize_t done = 0; n > 0 && done < n; ) {
+                ssize_t w = write(STDOUT_FILENO, buffer + done, (size_t)(n - done));
+                if (w == -1 && errno == EINTR) continue;
+                if (w == -1) {
+                    n = -1;
+                    break;
+                }
+                done += w;
+            }
+        }
+        if (n == 0) break;
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) {
+            fprintf(stderr, "cat: %s\n", strerror(errno));
+            ok = false;
+            break;
+        }
+    }
+    free(buffer);
+    return ok;
+}
+
+bool cat_handles(char** tokens, int token_count) {
+    for (int i = 1; i < token_count; i++) {
+        if (strcmp(tokens[i], "<") == 0 || strcmp(tokens[i], ">") == 0 || strcmp(tokens[i], ">>") == 0) {
+            i++;
+        } else if (tokens[i][0] == '-' && tokens[i][1] != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+int cat_command(char** tokens, int token_count) {
+    // Anything buffered comes before the raw writes below.
+    fflush(stdout);
+    if (token_count < 2) return copy_fd(STDIN_FILENO) ? 0 : 1;
+
+    int status = 0;
+    for (int i = 1; i < token_count; i++) {
+        if (strcmp(tokens[i], "-") == 0) {
+            if (!copy_fd(STDIN_FILENO)) status = 1;
+            continue;
+        }
+        int fd = open(tokens[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            fprintf(stderr, "cat: %s: %s\n", tokens[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (!copy_fd(fd)) status = 1;
+        close(fd);
+    }
+    return status;
+}
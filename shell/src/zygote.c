@@ -0,0 +1,308 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "../include/zygote.h"
+#include "../include/process.h"
+#include "../include/signals.h"
+
+#define ZYGOTE_MESSAGE_MAX (64 * 1024)
+#define ZYGOTE_SOCKET_FD 3
+
+#define ZYGOTE_BACKGROUND 1
+#define ZYGOTE_FOREGROUND_TTY 2
+
+extern bool is_interactive_mode;
+
+// Followed by the cwd, the tokens and the environment as NUL-terminated
+// strings. stdin, stdout and stderr travel as SCM_RIGHTS.
+typedef struct {
+    uint32_t token_count;
+    uint32_t env_count;
+    uint32_t flags;
+    int32_t pgid;
+} ZygoteRequest;
+
+// Idle helpers received from the pool process so far.
+static pid_t idle_pids[ZYGOTE_MAX];
+static int idle_sockets[ZYGOTE_MAX];
+static int idle_count = 0;
+// The pool process forks helpers and passes them to the shell over
+// control_socket, one for every byte the shell writes to ask for a refill.
+static pid_t pool_pid = -1;
+static int control_socket = -1;
+
+// Runs in the helper: waits for one request and becomes that command.
+static void zygote_main(void) {
+    static char message[ZYGOTE_MESSAGE_MAX];
+    static char* tokens[ZYGOTE_MESSAGE_MAX / 2];
+    static char* env[ZYGOTE_MESSAGE_MAX / 2];
+    int fds[3];
+    char control[CMSG_SPACE(sizeof(fds))];
+
+    struct iovec iov = { message, sizeof(message) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do {
+        n = recvmsg(ZYGOTE_SOCKET_FD, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    // The shell closing its end means the pool is being shut down.
+    if (n < (ssize_t)sizeof(ZygoteRequest)) _exit(0);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) _exit(126);
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    close(ZYGOTE_SOCKET_FD);
+
+    ZygoteRequest request;
+    memcpy(&request, message, sizeof(request));
+    char* p = message + sizeof(request);
+    char* cwd = p;
+    p += strlen(p) + 1;
+    for (uint32_t i = 0; i < request.token_count; i++) {
+        tokens[i] = p;
+        p += strlen(p) + 1;
+    }
+    tokens[request.token_count] = NULL;
+    for (uint32_t i = 0; i < request.env_count; i++) {
+        env[i] = p;
+        p += strlen(p) + 1;
+    }
+    env[request.env_count] = NULL;
+
+    setpgid(0, request.pgid);
+    if (request.flags & ZYGOTE_FOREGROUND_TTY) claim_terminal();
+    for (int i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    if (chdir(cwd) == -1) {
+        perror(cwd);
+        _exit(1);
+    }
+    environ = env;
+
+    run_command_in_child(tokens, (int)request.token_count, request.flags & ZYGOTE_BACKGROUND, NULL, NULL);
+    _exit(127);
+}
+
+// Creates one helper and passes the shell's end of its socket up. CLONE_PARENT
+// makes the helper a child of the shell, so the shell can wait for it and
+// put it in a job's process group like any command it forked itself.
+static bool spawn_zygote(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        return false;
+    }
+    pid_t pid = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+    if (pid == -1) {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        dup2(sv[1], ZYGOTE_SOCKET_FD);
+        close_range(ZYGOTE_SOCKET_FD + 1, ~0U, 0);
+        zygote_main();
+    }
+    close(sv[1]);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &pid, sizeof(pid) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &sv[0], sizeof(int));
+    ssize_t sent = sendmsg(ZYGOTE_SOCKET_FD, &msg, MSG_NOSIGNAL);
+    close(sv[0]);
+    return sent == (ssize_t)sizeof(pid);
+}
+
+// The pool process. It is forked once at startup, before the shell has grown,
+// so helpers forked from it are small and cheap to create and to exec from.
+static void pool_main(int size) {
+    int pending = size;
+    for (;;) {
+        while (pending > 0) {
+            if (!spawn_zygote()) _exit(1);
+            pending--;
+        }
+        char requests[ZYGOTE_MAX];
+        ssize_t n = read(ZYGOTE_SOCKET_FD, requests, sizeof(requests));
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) _exit(0);
+        pending += (int)n;
+    }
+}
+
+bool zygote_pool_init(int size) {
+    if (size <= 0) return true;
+    if (size > ZYGOTE_MAX) size = ZYGOTE_MAX;
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("socketpair");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // Its own process group keeps terminal signals for the shell's
+        // foreground job away from the pool and its idle helpers.
+        setpgid(0, 0);
+        reset_child_signals();
+        dup2(sv[1], ZYGOTE_SOCKET_FD);
+        close_range(ZYGOTE_SOCKET_FD + 1, ~0U, 0);
+        pool_main(size);
+    }
+    setpgid(pid, pid);
+    close(sv[1]);
+    pool_pid = pid;
+    control_socket = sv[0];
+    return true;
+}
+
+// Collects the helpers the pool process has finished since the last call.
+static void receive_zygotes(void) {
+    while (idle_count < ZYGOTE_MAX) {
+        pid_t pid;
+        int fd;
+        char control[CMSG_SPACE(sizeof(int))];
+        struct iovec iov = { &pid, sizeof(pid) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(control_socket, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(pid)) return;
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS) return;
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+        idle_pids[idle_count] = pid;
+        idle_sockets[idle_count] = fd;
+        idle_count++;
+    }
+}
+
+static bool append_string(char* message, size_t* length, const char* s) {
+    size_t n = strlen(s) + 1;
+    if (*length + n > ZYGOTE_MESSAGE_MAX) return false;
+    memcpy(message + *length, s, n);
+    *length += n;
+    return true;
+}
+
+pid_t zygote_launch(char** tokens, int token_count, bool run_in_background, pid_t pgid, int in_fd, int out_fd) {
+    static char message[ZYGOTE_MESSAGE_MAX];
+    if (control_socket == -1) return -1;
+
+    ZygoteRequest request = { (uint32_t)token_count, 0, 0, (int32_t)pgid };
+    if (run_in_background) request.flags |= ZYGOTE_BACKGROUND;
+    else if (is_interactive_mode) request.flags |= ZYGOTE_FOREGROUND_TTY;
+
+    size_t length = sizeof(request);
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL || !append_string(message, &length, cwd)) return -1;
+    for (int i = 0; i < token_count; i++) {
+        if (!append_string(message, &length, tokens[i])) return -1;
+    }
+    for (char** env = environ; *env != NULL; env++) {
+        if (!append_string(message, &length, *env)) return -1;
+        request.env_count++;
+    }
+    memcpy(message, &request, sizeof(request));
+
+    receive_zygotes();
+    if (idle_count == 0) return -1;
+    idle_count--;
+    pid_t pid = idle_pids[idle_count];
+    int sock = idle_sockets[idle_count];
+    // Ask for a replacement; the pool forks it while this command runs.
+    // If the pool is gone, later launches simply fall back to fork().
+    char refill = 1;
+    send(control_socket, &refill, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    int fds[3] = { in_fd != -1 ? in_fd : STDIN_FILENO, out_fd != -1 ? out_fd : STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { message, length };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    close(sock);
+    if (sent != (ssize_t)length) {
+        // The helper is gone; reap it and let the caller fork.
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    return pid;
+}
+
+void zygote_pool_shutdown(void) {
+    if (control_socket == -1) return;
+    // Closing the sockets makes the pool and every idle helper exit, including
+    // helpers still in flight on the control socket.
+    close(control_socket);
+    control_socket = -1;
+    waitpid(pool_pid, NULL, 0);
+    for (int i = 0; i < idle_count; i++) {
+        close(idle_sockets[i]);
+        waitpid(idle_pids[i], NULL, 0);
+    }
+    idle_count = 0;
+}
+
+void zygote_pool_detach(void) {
+    if (control_socket == -1) return;
+    close(control_socket);
+    control_socket = -1;
+    for (int i = 0; i < idle_count; i++) {
+        close(idle_sockets[i]);
+    }
+    idle_count = 0;
+}